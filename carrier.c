@@ -0,0 +1,243 @@
+/*
+ * carrier.c
+ *
+ * Kernel threads that run user threads, and the runtime lock they share.
+ */
+
+#include "ut369.h"
+#include "carrier.h"
+#include "thread.h"
+#include "interrupt.h"
+#include <assert.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+/* spins on a busy runtime lock before giving the CPU away, in case the
+ * holder's kernel thread is not running */
+#define CARRIER_SPINS 1000
+
+int nr_carriers = 1;
+
+struct carrier boot_carrier;
+static struct carrier *carriers = &boot_carrier;
+static __thread struct carrier *this_carrier = &boot_carrier;
+
+static int runtime_lock;
+
+/* bumped by carrier_kick, parked carriers wait for it to change */
+static unsigned work_seq;
+static int nr_parked;
+
+/* set by carrier_end, idle carriers exit when they see it */
+static int stopping;
+
+/* Pin the calling kernel thread, which runs carrier c, to c's CPU, and find
+ * out the node it is on. A CPU that cannot be used leaves c unpinned. */
+static void
+carrier_pin(struct carrier *c)
+{
+	cpu_set_t set;
+	unsigned int cpu, node;
+
+	c->node = -1;
+	if (c->cpu < 0) {
+		return;
+	}
+	CPU_ZERO(&set);
+	if (c->cpu >= CPU_SETSIZE) {
+		c->cpu = -1;
+		return;
+	}
+	CPU_SET(c->cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+		c->cpu = -1;
+		return;
+	}
+	if (getcpu(&cpu, &node) == 0) {
+		c->node = node;
+	}
+}
+
+void
+carrier_init(int n, const int *cpus)
+{
+	int ret;
+
+	nr_carriers = n > 1 ? n : 1;
+	if (nr_carriers > 1) {
+		carriers = calloc(nr_carriers, sizeof(struct carrier));
+		assert(carriers != NULL);
+	}
+	for (int i = 0; i < nr_carriers; i++) {
+		carriers[i].index = i;
+		carriers[i].cpu = cpus != NULL ? cpus[i] : -1;
+		carriers[i].node = -1;
+		carriers[i].perf_fd = -1;
+		carriers[i].exited = NULL;
+		carriers[i].segv_stack = (stack_t){ .ss_flags = SS_DISABLE };
+	}
+	carriers[0].pthread = pthread_self();
+	ret = pthread_getcpuclockid(carriers[0].pthread, &carriers[0].cpu_clock);
+	assert(ret == 0);
+	this_carrier = &carriers[0];
+	carrier_pin(&carriers[0]);
+}
+
+struct carrier *
+carrier_get(int index)
+{
+	assert(index >= 0 && index < nr_carriers);
+	return &carriers[index];
+}
+
+/* Not inlined: the address of this_carrier must be computed anew on each
+ * call, since the calling user thread may have moved to another kernel
+ * thread since the last one. */
+__attribute__((noinline)) struct carrier *
+carrier_lookup(void)
+{
+	return this_carrier;
+}
+
+/* Unregister and free the alternate signal stack of the calling carrier c,
+ * if it has one. */
+static void
+carrier_segv_stack_free(struct carrier *c)
+{
+	if (c->segv_stack.ss_sp == NULL) {
+		return;
+	}
+	c->segv_stack.ss_flags = SS_DISABLE;
+	sigaltstack(&c->segv_stack, NULL);
+	free(c->segv_stack.ss_sp);
+	c->segv_stack.ss_sp = NULL;
+}
+
+static void *
+carrier_main(void *arg)
+{
+	struct carrier *c = arg;
+
+	this_carrier = c;
+	carrier_pin(c);
+	// so that stack overflows are reported on this carrier too
+	c->segv_stack.ss_sp = malloc(SIGSTKSZ);
+	c->segv_stack.ss_size = SIGSTKSZ;
+	c->segv_stack.ss_flags = 0;
+	if (c->segv_stack.ss_sp != NULL &&
+	    sigaltstack(&c->segv_stack, NULL) != 0) {
+		free(c->segv_stack.ss_sp);
+		c->segv_stack.ss_sp = NULL;
+	}
+	interrupt_off();
+	interrupt_carrier();
+	thread_idle();
+	assert(false);
+	return NULL;
+}
+
+void
+carrier_start(void)
+{
+	for (int i = 1; i < nr_carriers; i++) {
+		int ret = pthread_create(&carriers[i].pthread, NULL, carrier_main,
+		                         &carriers[i]);
+		assert(ret == 0);
+		// the carrier waits for the runtime lock before it runs a thread
+		ret = pthread_getcpuclockid(carriers[i].pthread,
+		                            &carriers[i].cpu_clock);
+		assert(ret == 0);
+	}
+}
+
+/* Leave the idle loop for good, see carrier_end. Called with the runtime
+ * lock held. */
+static void
+carrier_exit(void)
+{
+	carrier_unlock();
+	carrier_segv_stack_free(this_carrier);
+	pthread_exit(NULL);
+}
+
+void
+carrier_end(void)
+{
+	struct carrier *self = this_carrier;
+
+	if (nr_carriers == 1) {
+		return;
+	}
+	__atomic_store_n(&stopping, 1, __ATOMIC_SEQ_CST);
+	__atomic_add_fetch(&work_seq, 1, __ATOMIC_SEQ_CST);
+	syscall(SYS_futex, &work_seq, FUTEX_WAKE_PRIVATE, nr_carriers, NULL,
+	        NULL, 0);
+	// the others need the lock to see that they are to stop
+	carrier_unlock();
+	for (int i = 0; i < nr_carriers; i++) {
+		if (&carriers[i] != self) {
+			int ret = pthread_join(carriers[i].pthread, NULL);
+			assert(ret == 0);
+		}
+	}
+	carrier_lock();
+	carrier_segv_stack_free(self);
+	stopping = 0;
+}
+
+void
+carrier_lock(void)
+{
+	int spins = 0;
+
+	while (__atomic_exchange_n(&runtime_lock, 1, __ATOMIC_ACQUIRE)) {
+		while (__atomic_load_n(&runtime_lock, __ATOMIC_RELAXED)) {
+			if (++spins < CARRIER_SPINS) {
+				__builtin_ia32_pause();
+			} else {
+				sched_yield();
+				spins = 0;
+			}
+		}
+	}
+}
+
+void
+carrier_unlock(void)
+{
+	__atomic_store_n(&runtime_lock, 0, __ATOMIC_RELEASE);
+}
+
+void
+carrier_wake(void)
+{
+	// a carrier about to park either sees the new sequence number, or is
+	// counted in nr_parked by now
+	__atomic_add_fetch(&work_seq, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&nr_parked, __ATOMIC_SEQ_CST) > 0) {
+		syscall(SYS_futex, &work_seq, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+	}
+}
+
+void
+carrier_park(void)
+{
+	// read under the lock, so no kick can fall between the caller finding
+	// nothing to run and the wait below
+	unsigned seq = __atomic_load_n(&work_seq, __ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&stopping, __ATOMIC_SEQ_CST)) {
+		carrier_exit();
+	}
+	carrier_unlock();
+	__atomic_add_fetch(&nr_parked, 1, __ATOMIC_SEQ_CST);
+	syscall(SYS_futex, &work_seq, FUTEX_WAIT_PRIVATE, seq, NULL, NULL, 0);
+	__atomic_sub_fetch(&nr_parked, 1, __ATOMIC_SEQ_CST);
+	carrier_lock();
+	if (__atomic_load_n(&stopping, __ATOMIC_SEQ_CST)) {
+		carrier_exit();
+	}
+}
@@ -0,0 +1,107 @@
+#ifndef _CARRIER_H_
+#define _CARRIER_H_
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <time.h>
+
+struct thread;
+
+/* A kernel thread that runs user threads. With config.carriers set to N > 1,
+ * ut369_start starts N - 1 carriers next to the calling kernel thread, which
+ * is carrier 0. All of them take ready threads from the scheduler. Otherwise
+ * there is only carrier 0, and the runtime behaves as a single kernel thread.
+ *
+ * Interrupts are disabled per carrier (see interrupt.c for why their state
+ * is kept in the carrier's TLS rather than here). With several carriers,
+ * disabling them
+ * also takes the runtime lock, so the critical sections that the runtime and
+ * the schedulers protect with interrupt_off stay atomic across carriers. The
+ * lock is held across context switches and released by the next thread to
+ * run on the same carrier, just as it re-enables interrupts. */
+struct carrier {
+	int index;
+	int cpu;                       /* pinned to, or -1 */
+	int node;                      /* NUMA node of cpu, or -1 if unpinned */
+	struct thread *current;        /* running user thread, or idle */
+	struct thread *idle;           /* runs thread_idle, NULL for 1 carrier */
+	bool has_timer;                /* timer or perf_fd was created */
+	timer_t timer;                 /* periodic tick, signals this carrier */
+	int perf_fd;                   /* perf event ticking instead, or -1 */
+	unsigned quantum;              /* period of the tick */
+	long switch_ns;                /* average cost of a preemption */
+	long switch_stamp;             /* start of the last preemption, or 0 */
+	bool stopped;                  /* tick stopped, no thread was ready */
+	int quiet_ticks;               /* in a row with no thread ready */
+	struct thread *exited;         /* switched away from for good, its
+	                                  stack not yet released */
+	stack_t segv_stack;            /* alternate signal stack, or none */
+	pthread_t pthread;
+	clockid_t cpu_clock;           /* CPU time of the kernel thread */
+};
+
+/* number of carriers, fixed by carrier_init */
+extern int nr_carriers;
+
+/* carrier 0 when it is the only one */
+extern struct carrier boot_carrier;
+
+/* Set up n carriers, the calling kernel thread being carrier 0. If cpus is
+ * not NULL, carrier i is pinned to CPU cpus[i]. */
+void carrier_init(int n, const int *cpus);
+
+/* Return carrier index, between 0 and nr_carriers - 1. */
+struct carrier *carrier_get(int index);
+
+/* Return whether a thread moving between carriers a and b changes NUMA node.
+ * Carriers that are not pinned could be anywhere, so they never do. */
+static inline bool
+carrier_remote(const struct carrier *a, const struct carrier *b)
+{
+	return a->node >= 0 && b->node >= 0 && a->node != b->node;
+}
+
+/* Start the kernel threads of carriers 1 and up, which run thread_idle. */
+void carrier_start(void);
+
+/* Stop the kernel threads of all carriers but the calling one, which must
+ * hold the runtime lock while the others are idle, and wait for them to
+ * exit. Used by ut369_end before the runtime is torn down. */
+void carrier_end(void);
+
+struct carrier *carrier_lookup(void);
+
+/* Return the carrier of the calling kernel thread. A user thread may be
+ * resumed on another carrier after any context switch, so the result must
+ * not be kept across one. */
+static inline struct carrier *
+carrier_self(void)
+{
+	if (nr_carriers == 1) {
+		return &boot_carrier;
+	}
+	return carrier_lookup();
+}
+
+/* the runtime lock, see interrupt_set */
+void carrier_lock(void);
+void carrier_unlock(void);
+
+void carrier_wake(void);
+
+/* Tell idle carriers that a thread was made ready. Called with the runtime
+ * lock held. */
+static inline void
+carrier_kick(void)
+{
+	if (nr_carriers > 1) {
+		carrier_wake();
+	}
+}
+
+/* Release the runtime lock and sleep until carrier_kick is called, then take
+ * the lock again. Used by the idle loop. */
+void carrier_park(void);
+
+#endif /* _CARRIER_H_ */
@@ -0,0 +1,110 @@
+/*
+ * cfs.c
+ *
+ * Implementation of a completely fair scheduler. Each thread is charged the
+ * time it actually ran, scaled by a weight derived from its priority, and
+ * the ready thread with the smallest weighted virtual runtime runs next.
+ */
+
+#include "ut369.h"
+#include "heap.h"
+#include "thread.h"
+#include "schedule.h"
+#include <stdint.h>
+
+/* weight of each priority level; every level is ~1.25x the next one, with
+ * CFS_WEIGHT_DEFAULT at THREAD_PRIO_DEFAULT (as Linux does for nice values) */
+#define CFS_WEIGHT_DEFAULT 1024
+static const uint32_t cfs_weights[THREAD_PRIO_LEVELS] = {
+    36291, 29154, 23254, 18705, 14949, 11916, 9548, 7620,
+     6100,  4904,  3906,  3121,  2501,  1991, 1586, 1277,
+     1024,   820,   655,   526,   423,   335,  272,  215,
+      172,   137,   110,    87,    70,    56,   45,   36,
+};
+
+static struct heap ready;
+
+/* Never decreases. New and woken threads start no earlier than this, so
+ * they cannot monopolize the CPU after a long sleep. */
+static uint64_t min_vruntime;
+
+/* Charge a thread that is giving up the CPU for the time it ran. The hooks
+ * that call this run before the thread is put back in the ready queue. */
+static void
+cfs_charge(struct thread *thread, uint64_t ran)
+{
+    thread->vruntime += ran * CFS_WEIGHT_DEFAULT /
+                        cfs_weights[thread->priority];
+}
+
+int 
+cfs_init(void)
+{
+    heap_init(&ready);
+    min_vruntime = 0;
+    return 0;
+}
+
+int
+cfs_enqueue(struct thread * thread)
+{
+    if (thread->vruntime < min_vruntime) {
+        thread->vruntime = min_vruntime;
+    }
+    thread->sched_node.key = thread->vruntime;
+    heap_insert(&ready, &thread->sched_node);
+    return 0;
+}
+
+struct thread *
+cfs_dequeue(void)
+{
+    struct heap_node *node;
+    struct thread *ret;
+
+    node = heap_pop(&ready);
+    if (node == NULL) {
+        return NULL;
+    }
+    ret = heap_entry(node, struct thread, sched_node);
+    if (ret->vruntime > min_vruntime) {
+        min_vruntime = ret->vruntime;
+    }
+    return ret;
+}
+
+struct thread *
+cfs_remove(Tid tid)
+{
+    struct thread *ret = thread_get(tid);
+
+    if (ret == NULL || !heap_contains(&ready, &ret->sched_node)) {
+        return NULL;
+    }
+    heap_remove(&ready, &ret->sched_node);
+    return ret;
+}
+
+void
+cfs_destroy(void)
+{
+    heap_init(&ready);
+}
+
+void
+cfs_on_yield(struct thread * thread, uint64_t ran)
+{
+    cfs_charge(thread, ran);
+}
+
+void
+cfs_on_tick(struct thread * thread, uint64_t ran)
+{
+    cfs_charge(thread, ran);
+}
+
+void
+cfs_on_block(struct thread * thread, uint64_t ran)
+{
+    cfs_charge(thread, ran);
+}
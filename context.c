@@ -0,0 +1,35 @@
+/*
+ * context.c
+ *
+ * Frame bootstrap for the hand-written context switch in switch.S.
+ */
+
+#include "context.h"
+#include <assert.h>
+#include <stdint.h>
+
+void *
+context_init(void *stack_top, void (*entry)(void *, void *),
+             void *arg0, void *arg1)
+{
+    struct context_frame *frame;
+    uintptr_t top = (uintptr_t)stack_top & ~(uintptr_t)15;
+
+    /* context_entry is reached by a ret, so the stack pointer just above the
+     * return address must be 16-byte aligned for its call to be ABI-correct */
+    frame = (struct context_frame *)(top - sizeof(struct context_frame));
+    assert(((uintptr_t)&frame->rip + 8) % 16 == 0);
+
+    __asm__ volatile ("stmxcsr %0" : "=m" (frame->mxcsr));
+    __asm__ volatile ("fnstcw %0" : "=m" (frame->fpucw));
+    frame->pad = 0;
+    frame->r15 = 0;
+    frame->r14 = 0;
+    frame->r13 = (uint64_t)arg1;
+    frame->r12 = (uint64_t)arg0;
+    frame->rbx = (uint64_t)entry;
+    frame->rbp = 0;
+    frame->rip = (uint64_t)context_entry;
+
+    return frame;
+}
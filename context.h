@@ -0,0 +1,48 @@
+/*
+ * context.h
+ *
+ * Minimal x86-64 context switch used by thread.c in place of
+ * getcontext/setcontext. Only the callee-saved registers, the stack pointer
+ * and the floating point control words are preserved across a switch. The
+ * signal mask is NOT saved or restored; callers are responsible for bringing
+ * interrupts back to the state they expect after a switch returns.
+ */
+
+#ifndef _CONTEXT_H_
+#define _CONTEXT_H_
+
+#include <stdint.h>
+
+/* Layout of the frame that context_switch leaves at the top of a suspended
+ * thread's stack, from the lowest address (the saved stack pointer) upwards.
+ * thread_create builds one of these by hand to bootstrap a new thread. */
+struct context_frame {
+    uint32_t mxcsr;      /* SSE control/status register */
+    uint16_t fpucw;      /* x87 control word */
+    uint16_t pad;
+    uint64_t r15;
+    uint64_t r14;
+    uint64_t r13;
+    uint64_t r12;
+    uint64_t rbx;
+    uint64_t rbp;
+    uint64_t rip;        /* return address of context_switch */
+};
+
+/* Save the current context on the current stack, store the resulting stack
+ * pointer in *save_sp, and resume the context whose stack pointer is load_sp.
+ * Returns when some other thread switches back to *save_sp. */
+void context_switch(void **save_sp, void *load_sp);
+
+/* Entry trampoline for a bootstrapped frame. It calls rbx(r12, r13) on a
+ * 16-byte aligned stack; the callee must never return. */
+void context_entry(void);
+
+/* Build an initial frame at the top of the stack ending at stack_top so that
+ * the first context_switch to the returned stack pointer calls
+ * entry(arg0, arg1). The floating point control words are inherited from the
+ * calling thread. */
+void *context_init(void *stack_top, void (*entry)(void *, void *),
+                   void *arg0, void *arg1);
+
+#endif /* _CONTEXT_H_ */
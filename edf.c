@@ -0,0 +1,73 @@
+/*
+ * edf.c
+ *
+ * Implementation of an earliest-deadline-first scheduler. The ready thread
+ * with the earliest deadline runs next, and threads without a deadline run
+ * only when no thread with one is ready. A thread that wakes up with an
+ * earlier deadline than the running thread preempts it.
+ */
+
+#include "ut369.h"
+#include "heap.h"
+#include "thread.h"
+#include "schedule.h"
+#include <stdint.h>
+
+static struct heap ready;
+
+/* threads without a deadline sort after every deadline */
+static uint64_t
+edf_key(struct thread *thread)
+{
+    return thread->deadline != 0 ? thread->deadline : UINT64_MAX;
+}
+
+int 
+edf_init(void)
+{
+    heap_init(&ready);
+    return 0;
+}
+
+int
+edf_enqueue(struct thread * thread)
+{
+    thread->sched_node.key = edf_key(thread);
+    heap_insert(&ready, &thread->sched_node);
+    return 0;
+}
+
+struct thread *
+edf_dequeue(void)
+{
+    struct heap_node *node = heap_pop(&ready);
+
+    if (node == NULL) {
+        return NULL;
+    }
+    return heap_entry(node, struct thread, sched_node);
+}
+
+struct thread *
+edf_remove(Tid tid)
+{
+    struct thread *ret = thread_get(tid);
+
+    if (ret == NULL || !heap_contains(&ready, &ret->sched_node)) {
+        return NULL;
+    }
+    heap_remove(&ready, &ret->sched_node);
+    return ret;
+}
+
+void
+edf_destroy(void)
+{
+    heap_init(&ready);
+}
+
+bool
+edf_preempts(struct thread * woken, struct thread * running)
+{
+    return edf_key(woken) < edf_key(running);
+}
@@ -17,7 +17,7 @@ static struct _fifo_queue *head = NULL;
 int 
 fcfs_init(void)
 {
-    head = queue_create(THREAD_MAX_THREADS);
+    head = queue_create(thread_max());
     if(head != NULL) {
         return 0;
     }
@@ -0,0 +1,143 @@
+/*
+ * heap.c
+ *
+ * Implementation of the intrusive pairing heap.
+ */
+
+#include "heap.h"
+#include <assert.h>
+
+void
+heap_init(struct heap *heap)
+{
+    heap->root = NULL;
+    heap->count = 0;
+    heap->seq = 0;
+}
+
+/* Whether a comes before b. Equal keys come out in insertion order, so that
+ * e.g. threads without a deadline under edf cannot starve each other. */
+static inline bool
+heap_before(struct heap_node *a, struct heap_node *b)
+{
+    return a->key < b->key || (a->key == b->key && a->seq < b->seq);
+}
+
+/* Link two detached trees, making the one with the larger key the leftmost
+ * child of the other. Returns the new root. */
+static struct heap_node *
+heap_meld(struct heap_node *a, struct heap_node *b)
+{
+    if (a == NULL) {
+        return b;
+    }
+    if (b == NULL) {
+        return a;
+    }
+    if (heap_before(b, a)) {
+        struct heap_node *t = a;
+        a = b;
+        b = t;
+    }
+    b->next = a->child;
+    if (a->child != NULL) {
+        a->child->prev = b;
+    }
+    b->prev = a;
+    a->child = b;
+    a->next = NULL;
+    a->prev = NULL;
+    return a;
+}
+
+/* Combine a list of siblings into a single tree with the standard two-pass
+ * pairing. Returns the new root, detached. */
+static struct heap_node *
+heap_merge_pairs(struct heap_node *first)
+{
+    struct heap_node *pairs = NULL;
+
+    // first pass: meld siblings pairwise, left to right, collecting the
+    // results in reverse order through their next pointers
+    while (first != NULL) {
+        struct heap_node *a = first;
+        struct heap_node *b = a->next;
+        struct heap_node *m;
+
+        first = b != NULL ? b->next : NULL;
+        a->next = a->prev = NULL;
+        if (b != NULL) {
+            b->next = b->prev = NULL;
+        }
+        m = heap_meld(a, b);
+        m->next = pairs;
+        pairs = m;
+    }
+
+    // second pass: meld the results right to left
+    struct heap_node *root = NULL;
+    while (pairs != NULL) {
+        struct heap_node *m = pairs;
+        pairs = m->next;
+        m->next = NULL;
+        root = heap_meld(root, m);
+    }
+    return root;
+}
+
+void
+heap_insert(struct heap *heap, struct heap_node *node)
+{
+    assert(!heap_contains(heap, node));
+    node->child = NULL;
+    node->next = NULL;
+    node->prev = NULL;
+    node->seq = heap->seq++;
+    heap->root = heap_meld(heap->root, node);
+    heap->count++;
+}
+
+struct heap_node *
+heap_pop(struct heap *heap)
+{
+    struct heap_node *top = heap->root;
+
+    if (top == NULL) {
+        return NULL;
+    }
+    heap->root = heap_merge_pairs(top->child);
+    heap->count--;
+    top->child = NULL;
+    assert(top->next == NULL && top->prev == NULL);
+    return top;
+}
+
+void
+heap_remove(struct heap *heap, struct heap_node *node)
+{
+    struct heap_node *sub;
+
+    assert(heap_contains(heap, node));
+    if (node == heap->root) {
+        heap_pop(heap);
+        return;
+    }
+
+    // unlink node (and its subtree) from its parent or left sibling
+    if (node->prev->child == node) {
+        node->prev->child = node->next;
+    } else {
+        node->prev->next = node->next;
+    }
+    if (node->next != NULL) {
+        node->next->prev = node->prev;
+    }
+    node->next = NULL;
+    node->prev = NULL;
+
+    // put its children back into the heap
+    sub = heap_merge_pairs(node->child);
+    node->child = NULL;
+    heap->root = heap_meld(heap->root, sub);
+    heap->count--;
+}
@@ -0,0 +1,63 @@
+/*
+ * heap.h
+ *
+ * Intrusive pairing heap keyed by an unsigned 64-bit value, used by the
+ * schedulers that order their ready queue (e.g., by virtual runtime). The
+ * minimum is always at the root, so peeking is O(1); insertion is O(1) and
+ * removal O(log n) amortized. Nodes with equal keys come out first-in,
+ * first-out.
+ */
+
+#ifndef _HEAP_H_
+#define _HEAP_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct heap_node {
+    uint64_t key;
+    uint64_t seq;               /* insertion order, breaks ties */
+    struct heap_node *child;    /* leftmost child */
+    struct heap_node *next;     /* right sibling */
+    struct heap_node *prev;     /* left sibling, or parent if leftmost */
+};
+
+struct heap {
+    struct heap_node *root;
+    int count;
+    uint64_t seq;
+};
+
+/* get the structure containing the heap node ptr */
+#define heap_entry(ptr, type, member) \
+    ((type *)((char *)(ptr) - offsetof(type, member)))
+
+void heap_init(struct heap *heap);
+
+/* Insert a node that is not in any heap, using its current key. */
+void heap_insert(struct heap *heap, struct heap_node *node);
+
+/* Return the node with the smallest key without removing it, or NULL if the
+ * heap is empty. */
+static inline struct heap_node *
+heap_top(struct heap *heap)
+{
+    return heap->root;
+}
+
+/* Remove and return the node with the smallest key, or NULL if the heap is
+ * empty. */
+struct heap_node *heap_pop(struct heap *heap);
+
+/* Remove node, which must be in heap. */
+void heap_remove(struct heap *heap, struct heap_node *node);
+
+/* Return whether node is currently in heap. */
+static inline bool
+heap_contains(struct heap *heap, struct heap_node *node)
+{
+    return node == heap->root || node->prev != NULL;
+}
+
+#endif /* _HEAP_H_ */
@@ -1,51 +1,386 @@
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <ucontext.h>
 #include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
 #include <sys/time.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include "ut369.h"
+#include "thread.h"
+#include "carrier.h"
 #include "interrupt.h"
 
+/* older glibc only has the raw member */
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
 static void interrupt_handler(int sig, siginfo_t * sip, void *contextVP);
-static void set_interrupt(void);
-static void set_signal(sigset_t * setp);
+static void set_interrupt(struct carrier *c);
+static void clear_interrupt(struct carrier *c);
 
 static int init = 0;
 static int loud = 0;
+static unsigned quantum_us;	/* or thousands of instructions */
+static unsigned quantum_min, quantum_max;
+static bool adaptive;
+static enum preempt_clock clock_source;
+
+/* The quantum of a carrier is picked again whenever it switches threads and
+ * on each tick, once interrupt_tuned is set: if the quantum adapts to the
+ * load, or since a thread got a quantum of its own. A thread's own quantum
+ * wins. Otherwise, the adaptive quantum is quantum_max when at most one
+ * thread per carrier is waiting, and halves each time that number doubles,
+ * so that a thread waits for one to two quantum_max whatever the load, until
+ * quantum_min is reached. Keeping to powers of two also means that the timer
+ * is rarely re-armed. The quantum stays above ADAPT_OVERHEAD times the cost of
+ * a preemption, measured from the tick to the next thread running, which
+ * keeps the preemptions below 1% of the time. */
+#define ADAPT_OVERHEAD 100
+bool interrupt_tuned = false;
+
+/* Ticks in a row that find no thread waiting for the CPU before the tick of
+ * a carrier stops. Preempting a thread that has nobody to give the CPU to is
+ * pointless, so the timer is disarmed until interrupt_resume. Waiting
+ * for a second quiet tick keeps threads that ping-pong through a lock or cv
+ * from stopping and restarting the timer all the time. */
+#define QUIET_TICKS 2
+
+/* number of carriers whose tick has stopped */
+static int nr_stopped;
+
+/* Interrupts are masked in software rather than with sigprocmask, separately
+ * on each carrier. While preempt_disabled is set, interrupt_handler only
+ * records the tick in preempt_pending, and the deferred preemption is taken
+ * by the interrupt_set call that re-enables interrupts. Nesting is handled by
+ * callers saving and restoring the value returned by interrupt_set, so a 0/1
+ * count suffices.
+ *
+ * Both live in the TLS of the carrier's kernel thread, and every access is a
+ * single instruction through %fs, so it applies to the carrier that the code
+ * runs on at that instant. While interrupts are enabled, a tick may move the
+ * thread to another carrier between any two instructions; finding the
+ * carrier first and then updating its state would update the wrong one. The
+ * TLS symbols are named in the asm, so the runtime must be linked into the
+ * executable (local-exec TLS). The asm also keeps the compiler from moving
+ * critical-section accesses across these updates. */
+static __thread volatile sig_atomic_t preempt_disabled __attribute__((used));
+static __thread volatile sig_atomic_t preempt_pending __attribute__((used));
+
+#define tls_load(var) ({                                                  \
+	int val_;                                                         \
+	__asm__ volatile("movl %%fs:" #var "@tpoff, %0"                   \
+	                 : "=r"(val_) : : "memory");                      \
+	val_;                                                             \
+})
+
+#define tls_store(var, val)                                               \
+	__asm__ volatile("movl %0, %%fs:" #var "@tpoff"                   \
+	                 : : "r"((int)(val)) : "memory")
+
+/* set var and return its old value, in one instruction */
+#define tls_exchange(var, val) ({                                         \
+	int val_ = (val);                                                 \
+	__asm__ volatile("xchgl %0, %%fs:" #var "@tpoff"                  \
+	                 : "+r"(val_) : : "memory");                      \
+	val_;                                                             \
+})
+
+/* Disable interrupts, and return whether they were enabled. With several
+ * carriers, a critical section also holds the runtime lock. It is taken
+ * after preempt_disabled is set, which pins the thread to its carrier, so
+ * that the handler never spins on a lock that its own carrier holds. */
+static inline int
+critical_enter(void)
+{
+	int enabled = !tls_exchange(preempt_disabled, 1);
+
+	if (enabled && nr_carriers > 1) {
+		carrier_lock();
+	}
+	return enabled;
+}
+
+static inline void
+critical_leave(void)
+{
+	if (nr_carriers > 1) {
+		carrier_unlock();
+	}
+	tls_store(preempt_disabled, 0);
+}
 
 /* Called as part of ut369_start. Many of the calls won't
  * make sense at first -- study the man pages! 
  */
 void
-interrupt_init(int verbose)
+interrupt_init(const struct config *config)
 {
 	struct sigaction action;
 	int error;
 
 	assert(!init);	/* should only register once */
 	init = 1;
-	loud = verbose;
+	loud = config->verbose;
+	quantum_us = config->quantum > 0 ? config->quantum : SIG_INTERVAL;
+	quantum_min = config->quantum_min > 0 ? config->quantum_min : 1;
+	quantum_max = config->quantum_max;
+	adaptive = quantum_max > quantum_min;
+	interrupt_tuned = adaptive;
+	clock_source = config->clock;
 	action.sa_handler = NULL;
 	action.sa_sigaction = interrupt_handler;
 	error = sigemptyset(&action.sa_mask);
 	assert(!error);
 
-	/* use sa_sigaction as handler instead of sa_handler */
-	action.sa_flags = SA_SIGINFO;
+	/* use sa_sigaction as handler instead of sa_handler. SIG_TYPE is not
+	 * blocked by the kernel while the handler runs (SA_NODEFER) because the
+	 * handler usually switches to another thread without returning, and
+	 * nothing would unblock it again; preempt_disabled guards against
+	 * recursion instead. Since the signal is no longer blocked inside
+	 * critical sections, restart any system call it interrupts. */
+	action.sa_flags = SA_SIGINFO | SA_NODEFER | SA_RESTART;
 	if (sigaction(SIG_TYPE, &action, NULL)) {
 		perror("Setting up signal handler");
 		assert(0);
 	}
 
-	/* block SIG_TYPE while interrupt_handler() is running. This will avoid
-	 * recursive interrupts where an interrupt occurs before the previous
-	 * interrupt handler has finished running.  */
+	/* keep interrupts disabled until ut369_start turns them on */
 	interrupt_off();
-	set_interrupt();
+	interrupt_carrier();
+}
+
+/* Open a perf event that counts for the calling kernel thread and sends it
+ * SIG_TYPE every period events, initially disabled. Returns its file
+ * descriptor, or -1 if the event is not available. */
+static int
+perf_open(uint32_t type, uint64_t config, uint64_t period)
+{
+	struct perf_event_attr attr = { 0 };
+	struct f_owner_ex owner = { F_OWNER_TID, gettid() };
+	int fd;
+
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.sample_period = period;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+	if (fd < 0) {
+		return -1;
+	}
+	if (fcntl(fd, F_SETOWN_EX, &owner) != 0 ||
+	    fcntl(fd, F_SETSIG, SIG_TYPE) != 0 ||
+	    fcntl(fd, F_SETFL, O_ASYNC) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* Create the tick of carrier c, which is the calling one. */
+static void
+tick_create(struct carrier *c)
+{
+	struct sigevent event = { 0 };
+	int ret;
+
+	if (clock_source == PREEMPT_CLOCK_INSTRUCTIONS) {
+		c->perf_fd = perf_open(PERF_TYPE_HARDWARE,
+		                       PERF_COUNT_HW_INSTRUCTIONS,
+		                       quantum_us * 1000ULL);
+		if (c->perf_fd < 0) {
+			// counts nanoseconds, so the period is quantum usecs
+			c->perf_fd = perf_open(PERF_TYPE_SOFTWARE,
+			                       PERF_COUNT_SW_TASK_CLOCK,
+			                       quantum_us * 1000ULL);
+		}
+		if (c->perf_fd >= 0) {
+			c->has_timer = true;
+			return;
+		}
+	}
+	event.sigev_notify = SIGEV_THREAD_ID;
+	event.sigev_signo = SIG_TYPE;
+	event.sigev_notify_thread_id = gettid();
+	// a CPU-time clock measures the kernel thread that creates the timer
+	ret = timer_create(clock_source == PREEMPT_CLOCK_REAL ? CLOCK_MONOTONIC :
+	                   CLOCK_THREAD_CPUTIME_ID, &event, &c->timer);
+	assert(!ret);
+	c->has_timer = true;
+}
+
+/* Start the preemption tick of the calling carrier. Each carrier has a
+ * periodic timer (or perf event) of its own that signals its own kernel
+ * thread, since a process-wide SIGALRM could be taken by any of them, and so
+ * that the tick needs no system call each time. */
+void
+interrupt_carrier(void)
+{
+	struct carrier *c = carrier_self();
+
+	if (!init) {
+		return;
+	}
+	if (!c->has_timer) {
+		tick_create(c);
+	}
+	c->quantum = quantum_us;
+	c->stopped = false;
+	c->quiet_ticks = 0;
+	set_interrupt(c);
+}
+
+/* Stop the timer of carrier c. */
+static void
+interrupt_stop(struct carrier *c)
+{
+	c->stopped = true;
+	nr_stopped++;
+	clear_interrupt(c);
+}
+
+static long
+now_ns(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+/* Return the quantum for carrier c to give its current thread. */
+static unsigned
+next_quantum(struct carrier *c)
+{
+	unsigned waiting, quantum, floor;
+
+	if (c->current->quantum != 0) {
+		return c->current->quantum;
+	}
+	if (!adaptive) {
+		return quantum_us;
+	}
+	waiting = (thread_nr_ready() + nr_carriers - 1) / nr_carriers;
+	quantum = quantum_max;
+	while (waiting > 1 && quantum > quantum_min) {
+		quantum /= 2;
+		waiting /= 2;
+	}
+	// a quantum of instructions is taken to last about as many usecs
+	floor = c->switch_ns * ADAPT_OVERHEAD / 1000;
+	if (quantum < floor) {
+		quantum = floor;
+	}
+	if (quantum < quantum_min) {
+		quantum = quantum_min;
+	} else if (quantum > quantum_max) {
+		quantum = quantum_max;
+	}
+	return quantum;
+}
+
+void
+interrupt_retune(void)
+{
+	struct carrier *c = carrier_self();
+	unsigned quantum;
+
+	if (!init) {
+		return;
+	}
+	if (c->switch_stamp != 0) {
+		// a preemption just ended, with or without a switch
+		c->switch_ns += (now_ns() - c->switch_stamp - c->switch_ns) / 8;
+		c->switch_stamp = 0;
+	}
+	quantum = next_quantum(c);
+	if (quantum != c->quantum) {
+		c->quantum = quantum;
+		if (!c->stopped) {
+			set_interrupt(c);
+		}
+	}
+}
+
+void
+interrupt_tune(void)
+{
+	if (init) {
+		interrupt_tuned = true;
+		interrupt_retune();
+	}
+}
+
+/* Account for a tick of carrier c, and stop its timer if no thread has been
+ * waiting for a while. Called with interrupts disabled, right before the
+ * preemption, which ends with interrupt_switched. */
+static void
+interrupt_tick(struct carrier *c)
+{
+	if (c->stopped) {
+		// a preemption asked for by interrupt_preempt
+		return;
+	}
+	if (thread_nr_ready() > 0) {
+		c->quiet_ticks = 0;
+	} else if (++c->quiet_ticks >= QUIET_TICKS) {
+		interrupt_stop(c);
+		return;
+	}
+	if (adaptive) {
+		c->switch_stamp = now_ns();
+	}
+}
+
+void
+interrupt_idle(bool idle)
+{
+	struct carrier *c = carrier_self();
+
+	if (!init) {
+		return;
+	}
+	if (idle && !c->stopped) {
+		interrupt_stop(c);
+	} else if (!idle && c->stopped) {
+		c->stopped = false;
+		nr_stopped--;
+		c->quiet_ticks = 0;
+		set_interrupt(c);
+	}
+	if (!idle) {
+		// a tick taken while idle has nothing to preempt
+		tls_store(preempt_pending, 0);
+	}
+}
+
+/* Restart the ticks of the carriers running a thread. Idle carriers restart
+ * their own when they find a thread, see interrupt_idle. */
+
+void
+interrupt_resume(void)
+{
+	if (nr_stopped == 0) {
+		return;
+	}
+	for (int i = 0; i < nr_carriers; i++) {
+		struct carrier *c = carrier_get(i);
+		if (c->stopped && c->current != c->idle) {
+			c->stopped = false;
+			nr_stopped--;
+			c->quiet_ticks = 0;
+			set_interrupt(c);
+		}
+	}
 }
 
 void
@@ -53,6 +388,16 @@ interrupt_end(void)
 {
 	/* ignore all subsequent signals */
 	signal(SIG_TYPE, SIG_IGN);
+	for (int i = 0; i < nr_carriers; i++) {
+		struct carrier *c = carrier_get(i);
+		if (c->has_timer && c->perf_fd >= 0) {
+			close(c->perf_fd);
+			c->perf_fd = -1;
+		} else if (c->has_timer) {
+			timer_delete(c->timer);
+		}
+		c->has_timer = false;
+	}
 	init = 0;
 }
 
@@ -71,35 +416,52 @@ interrupt_off(void)
 }
 
 /* enables or disables interrupts, and returns whether interrupts were enabled
- * or not previously. */
+ * or not previously. Re-enabling interrupts runs any preemption that was
+ * deferred while they were disabled. */
 int
 interrupt_set(int enabled)
 {
 	int ret;
-	sigset_t mask, omask;
 
-	set_signal(&mask);
-	if (enabled) {
-		ret = sigprocmask(SIG_UNBLOCK, &mask, &omask);
-	} else {
-		ret = sigprocmask(SIG_BLOCK, &mask, &omask);
+	if (!enabled) {
+		return critical_enter();
+	}
+
+	ret = !tls_load(preempt_disabled);
+	if (!ret) {
+		critical_leave();
+	}
+	// the thread may move to another carrier at any point until interrupts
+	// are disabled again, so the pending tick is checked again after that
+	while (tls_load(preempt_pending) && init) {
+		critical_enter();
+		if (tls_load(preempt_pending)) {
+			tls_store(preempt_pending, 0);
+			interrupt_tick(carrier_self());
+			thread_preempt();
+			// the load may have changed even if the thread kept running
+			interrupt_switched();
+		}
+		critical_leave();
+	}
+	return ret;
+}
+
+void
+interrupt_preempt(void)
+{
+	if (init) {
+		tls_store(preempt_pending, 1);
 	}
-	assert(!ret);
-	return (sigismember(&omask, SIG_TYPE) ? 0 : 1);
 }
 
 int
 interrupt_enabled(void)
 {
-	sigset_t mask;
-	int ret;
-
 	if (!init)
 		return 0;
 
-	ret = sigprocmask(0, NULL, &mask);
-	assert(!ret);
-	return (sigismember(&mask, SIG_TYPE) ? 0 : 1);
+	return !tls_load(preempt_disabled);
 }
 
 void
@@ -143,17 +505,6 @@ unintr_printf(const char *fmt, ...)
 
 /* static functions */
 
-static void
-set_signal(sigset_t * setp)
-{
-	int ret;
-	ret = sigemptyset(setp);
-	assert(!ret);
-	ret = sigaddset(setp, SIG_TYPE);
-	assert(!ret);
-	return;
-}
-
 static int first = 1;
 static struct timeval start, end, diff = { 0, 0 };
 
@@ -168,9 +519,16 @@ interrupt_handler(int sig, siginfo_t * sip, void *contextVP)
 	(void)sig;
 	(void)sip;
 
-	/* check that SIG_TYPE is blocked on entry. 
-	 * this signal should be blocked because of the sigemptyset call in
-	 * register_interrupt_handler(). */
+	/* interrupted a critical section: let the final interrupt_set take the
+	 * preemption once interrupts are enabled again. A nested tick may move
+	 * the thread before interrupts are disabled here, hence the single
+	 * exchange and no carrier until then. */
+	if (!critical_enter()) {
+		tls_store(preempt_pending, 1);
+		return;
+	}
+	tls_store(preempt_pending, 0);
+
 	assert(!interrupt_enabled());
 	if (loud) {
 		int ret;
@@ -187,27 +545,56 @@ interrupt_handler(int sig, siginfo_t * sip, void *contextVP)
 		       diff.tv_sec * 1000000 + diff.tv_usec);
 	}
 
-	set_interrupt();
-	/* implement preemptive threading by calling thread_yield */
-	thread_yield(THREAD_ANY);
+	interrupt_tick(carrier_self());
+	/* implement preemptive threading by calling thread_preempt */
+	thread_preempt();
+	// the load may have changed even if the thread kept running
+	interrupt_switched();
+
+	/* interrupts were necessarily enabled when this signal was taken */
+	interrupt_on();
 }
 
 /*
- * Use the setitimer() system call to set an alarm in the future. At that time,
- * this process will receive a SIGALRM signal.
+ * Use the timer_settime() system call to make the timer of carrier c expire
+ * every quantum from now on. Each time, the kernel thread of the carrier will
+ * receive a SIGALRM signal. A perf event is enabled instead, counting from 0.
  */
 static void
-set_interrupt(void)
+set_interrupt(struct carrier *c)
 {
+	struct itimerspec spec;
 	int ret;
-	struct itimerval val;
 
-	val.it_interval.tv_sec = 0;
-	val.it_interval.tv_usec = 0;
+	if (c->perf_fd >= 0) {
+		uint64_t period = c->quantum * 1000ULL;
+		ret = ioctl(c->perf_fd, PERF_EVENT_IOC_PERIOD, &period);
+		assert(!ret);
+		ret = ioctl(c->perf_fd, PERF_EVENT_IOC_RESET, 0);
+		assert(!ret);
+		ret = ioctl(c->perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+		assert(!ret);
+		return;
+	}
+	spec.it_interval.tv_sec = c->quantum / 1000000;
+	spec.it_interval.tv_nsec = c->quantum % 1000000 * 1000L;
+	spec.it_value = spec.it_interval;
+	ret = timer_settime(c->timer, 0, &spec, NULL);
+	assert(!ret);
+}
 
-	val.it_value.tv_sec = 0;
-	val.it_value.tv_usec = SIG_INTERVAL;
+/* Disarm the timer of carrier c. */
+static void
+clear_interrupt(struct carrier *c)
+{
+	struct itimerspec spec = { { 0, 0 }, { 0, 0 } };
+	int ret;
 
-	ret = setitimer(ITIMER_REAL, &val, NULL);
+	if (c->perf_fd >= 0) {
+		ret = ioctl(c->perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+		assert(!ret);
+		return;
+	}
+	ret = timer_settime(c->timer, 0, &spec, NULL);
 	assert(!ret);
 }
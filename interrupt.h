@@ -2,20 +2,60 @@
 #define _INTERRUPT_H_
 
 #include <signal.h>
+#include <stdbool.h>
+#include "ut369.h"
 
 /* we will use this signal type for delivering "interrupts". */
 #define SIG_TYPE SIGALRM
 
-/* in preemptive mode, the interrupt will be delivered every 200 usec */
+/* in preemptive mode, the interrupt will be delivered every 200 usec unless
+ * config.quantum says otherwise */
 #define SIG_INTERVAL 200
 
-void interrupt_init(int verbose);
+void interrupt_init(const struct config *config);
 void interrupt_end(void);
 
+/* start the preemption timer of the calling carrier, see carrier.h. Does
+ * nothing without preemption. */
+void interrupt_carrier(void);
+
 int interrupt_on(void);
 int interrupt_off(void);
 int interrupt_set(int enabled);
 
+/* restart the ticks that stopped while no thread was ready, must be called
+ * with interrupts disabled when a thread is made ready */
+void interrupt_resume(void);
+
+/* stop the tick of the calling carrier while it waits in the idle loop, or
+ * restart it once the carrier has found a thread to run. Must be called with
+ * interrupts disabled. */
+void interrupt_idle(bool idle);
+
+/* set when the quantum may change from one thread or tick to the next,
+ * see interrupt.c */
+extern bool interrupt_tuned;
+
+void interrupt_retune(void);
+
+/* pick the quantum of the thread that the calling carrier has just switched
+ * to, must be called with interrupts disabled */
+static inline void
+interrupt_switched(void)
+{
+	if (interrupt_tuned) {
+		interrupt_retune();
+	}
+}
+
+/* pick a new quantum on every switch from now on, because a thread was
+ * given a quantum of its own. Must be called with interrupts disabled. */
+void interrupt_tune(void);
+
+/* preempt the running thread as soon as interrupts are enabled, must be
+ * called with interrupts disabled. Does nothing without preemption. */
+void interrupt_preempt(void);
+
 /* check if interrupt is enabled */
 int interrupt_enabled(void);
 
@@ -0,0 +1,111 @@
+/*
+ * lottery.c
+ *
+ * Implementation of a lottery scheduler. A ticket is drawn among the tickets
+ * of all the ready threads, and its holder runs next, so each thread is
+ * picked with a probability proportional to its tickets.
+ *
+ * The ready threads are indexed by Tid in a Fenwick tree of ticket counts, so
+ * adding or removing a thread and finding the holder of a ticket are all
+ * O(log n) in the maximum number of threads.
+ */
+
+#include "ut369.h"
+#include "thread.h"
+#include "schedule.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+static struct thread **ready = NULL;  /* ready threads, indexed by Tid */
+static uint64_t *tree = NULL;         /* 1-based Fenwick tree of tickets */
+static int size;
+static int top_bit;                   /* largest power of 2 <= size */
+static uint64_t total;
+
+static void
+lottery_add(Tid tid, int64_t tickets)
+{
+    int ii;
+
+    for (ii = tid + 1; ii <= size; ii += ii & -ii) {
+        tree[ii] += tickets;
+    }
+    total += tickets;
+}
+
+/* return the Tid holding ticket number, which must be below total */
+static Tid
+lottery_find(uint64_t ticket)
+{
+    int pos = 0;
+    int step;
+
+    for (step = top_bit; step > 0; step >>= 1) {
+        if (pos + step <= size && tree[pos + step] <= ticket) {
+            pos += step;
+            ticket -= tree[pos];
+        }
+    }
+    return pos;
+}
+
+int 
+lottery_init(void)
+{
+    size = thread_max();
+    ready = calloc(size, sizeof(struct thread *));
+    tree = calloc(size + 1, sizeof(uint64_t));
+    if (ready == NULL || tree == NULL) {
+        free(ready);
+        free(tree);
+        ready = NULL;
+        tree = NULL;
+        return THREAD_NOMEMORY;
+    }
+    for (top_bit = 1; top_bit * 2 <= size; top_bit *= 2);
+    total = 0;
+    return 0;
+}
+
+int
+lottery_enqueue(struct thread * thread)
+{
+    if (thread->id < 0 || thread->id >= size || ready[thread->id] != NULL) {
+        return THREAD_NOMORE;
+    }
+    ready[thread->id] = thread;
+    lottery_add(thread->id, thread->tickets);
+    return 0;
+}
+
+struct thread *
+lottery_dequeue(void)
+{
+    if (total == 0) {
+        return NULL;
+    }
+    return lottery_remove(lottery_find(thread_random() % total));
+}
+
+struct thread *
+lottery_remove(Tid tid)
+{
+    struct thread *ret;
+
+    if (tid < 0 || tid >= size || ready[tid] == NULL) {
+        return NULL;
+    }
+    ret = ready[tid];
+    ready[tid] = NULL;
+    lottery_add(tid, -(int64_t)ret->tickets);
+    return ret;
+}
+
+void
+lottery_destroy(void)
+{
+    free(ready);
+    free(tree);
+    ready = NULL;
+    tree = NULL;
+}
@@ -0,0 +1,183 @@
+/*
+ * mlfq.c
+ *
+ * Implementation of a multi-level feedback queue scheduler. Threads start at
+ * the top level and are demoted one level each time they use up
+ * MLFQ_ALLOTMENT full quanta there, so CPU-bound threads sink while threads
+ * that yield or block before the timer fires stay on top and get to run
+ * first. Every MLFQ_BOOST_USECS, all threads go back to the top level, so
+ * that demoted threads cannot starve and threads whose behavior changed get
+ * another chance.
+ */
+
+#include "ut369.h"
+#include "queue.h"
+#include "thread.h"
+#include "schedule.h"
+#include <stdint.h>
+#include <time.h>
+#include <assert.h>
+
+#define MLFQ_LEVELS 8
+#define MLFQ_ALLOTMENT 2        /* full quanta before demotion */
+#define MLFQ_BOOST_USECS 50000
+
+_Static_assert(MLFQ_LEVELS <= 32, "ready_mask has 32 bits");
+
+static struct _fifo_queue *levels[MLFQ_LEVELS];
+
+/* bit i is set iff levels[i] is not empty */
+static uint32_t ready_mask = 0;
+
+/* Bumped at each boost. Threads that were not ready at the time of a boost
+ * are moved to the top when they are enqueued next, so a boost does not need
+ * to find them. */
+static unsigned epoch;
+static uint64_t last_boost;
+
+static uint64_t
+mlfq_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void
+mlfq_push(struct thread *thread)
+{
+    int ret = queue_push(levels[thread->level], thread);
+
+    assert(ret == 0);
+    ready_mask |= (uint32_t)1 << thread->level;
+}
+
+/* move every ready thread to the top level, oldest levels first */
+static void
+mlfq_boost(void)
+{
+    uint32_t mask = ready_mask & ~(uint32_t)1;
+
+    epoch++;
+    while (mask != 0) {
+        int level = __builtin_ctz(mask);
+        struct thread *thread;
+
+        while ((thread = queue_pop(levels[level])) != NULL) {
+            thread->level = 0;
+            thread->level_ticks = 0;
+            thread->level_epoch = epoch;
+            mlfq_push(thread);
+        }
+        ready_mask &= ~((uint32_t)1 << level);
+        mask &= mask - 1;
+    }
+}
+
+int 
+mlfq_init(void)
+{
+    for (int i = 0; i < MLFQ_LEVELS; i++) {
+        levels[i] = queue_create(thread_max());
+        if (levels[i] == NULL) {
+            while (i-- > 0) {
+                queue_destroy(levels[i]);
+                levels[i] = NULL;
+            }
+            return THREAD_NOMEMORY;
+        }
+    }
+    ready_mask = 0;
+    epoch = 0;
+    last_boost = mlfq_now();
+    return 0;
+}
+
+/* move a thread that missed a boost to the top */
+static void
+mlfq_refresh(struct thread *thread)
+{
+    if (thread->level_epoch != epoch) {
+        thread->level = 0;
+        thread->level_ticks = 0;
+        thread->level_epoch = epoch;
+    }
+}
+
+int
+mlfq_enqueue(struct thread * thread)
+{
+    mlfq_refresh(thread);
+    if (queue_push(levels[thread->level], thread) != 0) {
+        return THREAD_NOMORE;
+    }
+    ready_mask |= (uint32_t)1 << thread->level;
+    return 0;
+}
+
+struct thread *
+mlfq_dequeue(void)
+{
+    struct thread * ret;
+    uint64_t now;
+    int level;
+
+    if (ready_mask == 0) {
+        return NULL;
+    }
+
+    now = mlfq_now();
+    if (now - last_boost >= MLFQ_BOOST_USECS) {
+        last_boost = now;
+        mlfq_boost();
+    }
+
+    level = __builtin_ctz(ready_mask);
+    ret = queue_pop(levels[level]);
+    if (queue_count(levels[level]) == 0) {
+        ready_mask &= ~((uint32_t)1 << level);
+    }
+    return ret;
+}
+
+struct thread *
+mlfq_remove(Tid tid)
+{
+    struct thread * ret = thread_get(tid);
+    int level;
+
+    if (ret == NULL) {
+        return NULL;
+    }
+    /* a ready thread is always in the queue of its current level */
+    level = ret->level;
+    ret = queue_remove_node(levels[level], ret);
+    if (ret != NULL && queue_count(levels[level]) == 0) {
+        ready_mask &= ~((uint32_t)1 << level);
+    }
+    return ret;
+}
+
+/* only a used-up quantum counts against the allotment, so yielding or
+ * blocking early keeps a thread where it is */
+void
+mlfq_on_tick(struct thread * thread, uint64_t ran)
+{
+    (void)ran;
+    mlfq_refresh(thread);
+    if (++thread->level_ticks >= MLFQ_ALLOTMENT &&
+        thread->level < MLFQ_LEVELS - 1) {
+        thread->level++;
+        thread->level_ticks = 0;
+    }
+}
+
+void
+mlfq_destroy(void)
+{
+    for (int i = 0; i < MLFQ_LEVELS; i++) {
+        queue_destroy(levels[i]);
+        levels[i] = NULL;
+    }
+    ready_mask = 0;
+}
@@ -0,0 +1,105 @@
+/*
+ * prio.c
+ *
+ * Implementation of a strict priority scheduler. Each priority level has its
+ * own FIFO, and a bitmap of non-empty levels lets dequeue find the most
+ * urgent level with a single count-trailing-zeros instruction. A woken thread
+ * that is more urgent than the running thread preempts it.
+ */
+
+#include "ut369.h"
+#include "queue.h"
+#include "thread.h"
+#include "schedule.h"
+#include <stdint.h>
+#include <assert.h>
+
+_Static_assert(THREAD_PRIO_LEVELS <= 32, "ready_mask has 32 bits");
+
+static struct _fifo_queue *levels[THREAD_PRIO_LEVELS];
+
+/* bit i is set iff levels[i] is not empty */
+static uint32_t ready_mask = 0;
+
+int 
+prio_init(void)
+{
+    for (int i = 0; i < THREAD_PRIO_LEVELS; i++) {
+        levels[i] = queue_create(thread_max());
+        if (levels[i] == NULL) {
+            while (i-- > 0) {
+                queue_destroy(levels[i]);
+                levels[i] = NULL;
+            }
+            return THREAD_NOMEMORY;
+        }
+    }
+    ready_mask = 0;
+    return 0;
+}
+
+int
+prio_enqueue(struct thread * thread)
+{
+    int level = thread->priority;
+
+    assert(level >= 0 && level < THREAD_PRIO_LEVELS);
+    if (queue_push(levels[level], thread) != 0) {
+        return THREAD_NOMORE;
+    }
+    ready_mask |= (uint32_t)1 << level;
+    return 0;
+}
+
+struct thread *
+prio_dequeue(void)
+{
+    struct thread * ret;
+    int level;
+
+    if (ready_mask == 0) {
+        return NULL;
+    }
+
+    level = __builtin_ctz(ready_mask);
+    ret = queue_pop(levels[level]);
+    if (queue_count(levels[level]) == 0) {
+        ready_mask &= ~((uint32_t)1 << level);
+    }
+    return ret;
+}
+
+struct thread *
+prio_remove(Tid tid)
+{
+    struct thread * ret = thread_get(tid);
+    int level;
+
+    if (ret == NULL) {
+        return NULL;
+    }
+    /* a ready thread is in the queue of the priority it was enqueued with,
+     * and thread_setprio takes it out before changing it */
+    level = ret->priority;
+    ret = queue_remove_node(levels[level], ret);
+    if (ret != NULL && queue_count(levels[level]) == 0) {
+        ready_mask &= ~((uint32_t)1 << level);
+    }
+    return ret;
+}
+
+bool
+prio_preempts(struct thread * woken, struct thread * running)
+{
+    return woken->priority < running->priority;
+}
+
+void
+prio_destroy(void)
+{
+    for (int i = 0; i < THREAD_PRIO_LEVELS; i++) {
+        queue_destroy(levels[i]);
+        levels[i] = NULL;
+    }
+    ready_mask = 0;
+}
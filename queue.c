@@ -20,12 +20,14 @@ struct _fifo_queue {
 void node_init(node_item_t * node, int id)
 {
     node->id = id;
-    node->in_queue = false;
+    node->in_queue = NULL;
+    node->next = NULL;
+    node->prev = NULL;
 }
 
 bool node_in_queue(node_item_t * node)
 {
-    return node->in_queue;
+    return node->in_queue != NULL;
 }
 
 fifo_queue_t * queue_create(unsigned capacity)
@@ -55,28 +57,7 @@ void queue_destroy(fifo_queue_t * queue)
 
 node_item_t * queue_pop(fifo_queue_t * queue)
 {
-    if(queue->size == 0){
-        return NULL;
-    }
-    if(queue->size == 1){
-        node_item_t *head = queue->head;
-        queue->head = NULL;
-        queue->tail = NULL;
-        queue->size -= 1;
-        head->in_queue = false;
-        head->prev = NULL;
-        head->next = NULL;
-        return head;
-    }
-    else{
-        node_item_t *head = queue->head;
-        queue->head = queue->head->next; // head is now shifted one to the right
-        queue->size -= 1; // size decreases
-        head->in_queue = false; // toggle information about the dumped head
-        head->prev = NULL;
-        head->next = NULL;
-        return head;
-    }
+    return queue_remove_node(queue, queue->head);
 }
 
 node_item_t * queue_top(fifo_queue_t * queue)
@@ -91,67 +72,53 @@ int queue_push(fifo_queue_t * queue, node_item_t * node)
 {
     // make sure we aren't enqueuing a node that already belongs to another queue.
     assert(!node_in_queue(node));
-    
-    assert(!node_in_queue(node));
 
     if (queue->size == queue->capacity) {
         return -1;
     }
-    node_item_t *tail = queue->tail;
-    if (tail != NULL) {
-        tail->next = node;
-        node->prev = tail;
-        queue->size += 1;
-        queue->tail = node;
-        node->in_queue = true;
-        return 0;
+    node->prev = queue->tail;
+    node->next = NULL;
+    if (queue->tail != NULL) {
+        queue->tail->next = node;
     }
     else{
         queue->head = node;
-        queue->tail = node;
-        queue->size += 1;
-        node->in_queue = true;
-        return 0;
     }
-
-    return -1;
+    queue->tail = node;
+    queue->size += 1;
+    node->in_queue = queue;
+    return 0;
 }
 
-node_item_t * queue_remove(fifo_queue_t * queue, int id)
+node_item_t * queue_remove_node(fifo_queue_t * queue, node_item_t * node)
 {
-    if (queue->size == 0) {
+    // every node knows the queue it is in, so there is nothing to search
+    if (node == NULL || node->in_queue != queue) {
         return NULL;
     }
+    if (node->prev != NULL) {
+        node->prev->next = node->next;
+    }
     else{
-        int index = 0;
-        node_item_t *curr = queue->head;
-        while(curr != NULL){
-            if (curr->id == id) {
-                if (queue->size == 1){
-                    queue->head = NULL;
-                    queue->tail = NULL;
-                }
-                else if (index == 0){
-                    queue->head = curr->next;
-                }
-                else if(index == queue->size - 1){
-                    queue->tail = curr->prev;
-                }
-                else{
-                    curr->prev->next = curr->next;
-                    curr->next->prev = curr->prev;
-                }
-                queue->size -= 1;
-                curr->in_queue = false;
-                curr->next = NULL;
-                curr->prev = NULL;
-                return curr;
-            }
-            curr = curr->next;
-            index += 1;
-        }
+        queue->head = node->next;
     }
-    return NULL;
+    if (node->next != NULL) {
+        node->next->prev = node->prev;
+    }
+    else{
+        queue->tail = node->prev;
+    }
+    queue->size -= 1;
+    node->in_queue = NULL;
+    node->next = NULL;
+    node->prev = NULL;
+    return node;
+}
+
+node_item_t * queue_remove(fifo_queue_t * queue, int id)
+{
+    // nodes are threads, so find the node through the thread table
+    return queue_remove_node(queue, thread_get(id));
 }
 
 
@@ -175,11 +142,5 @@ void * queue_get_owner(fifo_queue_t * queue){
 }
 
 void queue_set_owner(fifo_queue_t * queue, void *owner){
-    if (owner == NULL){
-        queue->owner = NULL;
-    }
-    if(*(struct thread **)owner == NULL){
-        queue->owner = NULL;
-    }
     queue->owner = (struct thread **)owner;
 }
\ No newline at end of file
@@ -60,10 +60,17 @@ node_item_t * queue_top(fifo_queue_t * queue);
  */
 int queue_push(fifo_queue_t * queue, node_item_t * node);
 
+/*
+ * Remove the node from the queue and return it, in O(1).
+ * Return NULL if node is NULL or is not in this queue.
+ */
+node_item_t * queue_remove_node(fifo_queue_t * queue, node_item_t * node);
+
 /*
  * Return the node in the queue with the specified id and removes it from the queue.
  * You may assume all ids in a queue are unique.
  * Return NULL if no node in the queue has the specified id.
+ * The node is found through the thread table, so this is O(1) as well.
  */
 node_item_t * queue_remove(fifo_queue_t * queue, int id);
 
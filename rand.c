@@ -2,6 +2,9 @@
  * rand.c
  *
  * Implementation of a random scheduler (schedules runnable threads randomly)
+ *
+ * Each ready thread records its index in the ready array, so removing a
+ * thread by Tid is O(1): it is swapped with the last entry.
  */
 
 #include "ut369.h"
@@ -13,11 +16,13 @@
 
 static struct thread ** prio_queue = NULL;
 static int count = 0;
+static int capacity = 0;
 
 int 
 rand_init(void)
 {
-    prio_queue = malloc(sizeof(struct thread *)*THREAD_MAX_THREADS);
+    capacity = thread_max();
+    prio_queue = malloc(sizeof(struct thread *)*capacity);
     count = 0;
     
     if (prio_queue != NULL) {
@@ -33,55 +38,51 @@ rand_enqueue(struct thread * thread)
 {
     assert(!interrupt_enabled());
     
-    if (count >= THREAD_MAX_THREADS) {
+    if (count >= capacity) {
         return THREAD_NOMORE;
     }
 
+    thread->slot = count;
     prio_queue[count++] = thread;
     return 0;
 }
 
+/* take the thread in slot i out of the ready array */
+static struct thread *
+rand_take(int i)
+{
+    struct thread * ret = prio_queue[i];
+
+    // override rq[i] with last element
+    prio_queue[i] = prio_queue[--count];
+    prio_queue[i]->slot = i;
+    ret->slot = -1;
+    return ret;
+}
+
 struct thread *
 rand_dequeue(void)
 {
-    struct thread * ret;
-    int i;
-
     assert(!interrupt_enabled());
     if (count <= 0) {
         return NULL;
     }
 
-    i = rand() % count;
-    ret = prio_queue[i];
-    
-    // override rq[i] with last element
-    prio_queue[i] = prio_queue[--count];
-
-    return ret;
+    return rand_take(thread_random_below(count));
 }
 
 struct thread *
 rand_remove(Tid tid)
 {
-    struct thread * ret = NULL;
-    int i;
+    struct thread * thread = thread_get(tid);
 
     assert(!interrupt_enabled());
-    for (i = 0; i < count; i++) {
-        if (prio_queue[i]->id == tid) {
-            ret = prio_queue[i];
-            break;
-        }
-    }
-
-    // override rq[i] with last element (if found)
-    if (ret != NULL) {  
-        assert(count > 0);
-        prio_queue[i] = prio_queue[--count];
+    if (thread == NULL || thread->slot < 0 || thread->slot >= count ||
+        prio_queue[thread->slot] != thread) {
+        return NULL;
     }
 
-    return ret;
+    return rand_take(thread->slot);
 }
 
 void
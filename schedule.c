@@ -11,6 +11,7 @@
 #include "schedule.h"
 #include <string.h>
 #include <assert.h>
+#include <dlfcn.h>
 
 // current scheduler
 struct scheduler * scheduler;
@@ -18,34 +19,176 @@ struct scheduler * scheduler;
 // set of available schedulers
 struct scheduler schedulers[] = {
 #define S(name) \
-    { #name, name ## _init, name ## _enqueue, name ## _dequeue, name ## _remove, name ## _destroy },
+    { #name, name ## _init, name ## _enqueue, name ## _dequeue, name ## _remove, name ## _destroy, name ## _preempts, \
+      name ## _drain, name ## _on_yield, name ## _on_tick, name ## _on_block, name ## _on_wake, name ## _on_exit, false },
     SCHEDULERS
 #undef S
 };
 
 const int num_schedulers = sizeof(schedulers)/sizeof(struct scheduler);
 
+/* Schedulers loaded from shared objects. Each is copied out of its plugin,
+ * so calling it costs the same as calling a built-in scheduler. There are
+ * two slots so that a plugin can be switched to from another one. */
+static struct scheduler plugins[2];
+static void * plugin_handles[2];
+
+/* load the plugin at path into a free slot */
+static struct scheduler *
+scheduler_load(const char * path)
+{
+    int i = scheduler == &plugins[0] ? 1 : 0;
+    struct scheduler * exported;
+    void * handle;
+
+    assert(plugin_handles[i] == NULL);
+    handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL) {
+        return NULL;
+    }
+    exported = dlsym(handle, SCHEDULER_PLUGIN_SYMBOL);
+    if (exported == NULL || exported->init == NULL ||
+        exported->enqueue == NULL || exported->dequeue == NULL ||
+        exported->remove == NULL || exported->destroy == NULL) {
+        dlclose(handle);
+        return NULL;
+    }
+    plugins[i] = *exported;
+    if (plugins[i].name == NULL) {
+        plugins[i].name = path;
+    }
+    plugin_handles[i] = handle;
+    return &plugins[i];
+}
+
+/* unload s if it came from a plugin */
+static void
+scheduler_unload(struct scheduler * s)
+{
+    for (int i = 0; i < 2; i++) {
+        if (s == &plugins[i] && plugin_handles[i] != NULL) {
+            dlclose(plugin_handles[i]);
+            plugin_handles[i] = NULL;
+        }
+    }
+}
+
+static bool
+scheduler_is_plugin(struct scheduler * s)
+{
+    return s == &plugins[0] || s == &plugins[1];
+}
+
+/* whether s was loaded from the plugin that is already in use */
+static bool
+scheduler_loaded(struct scheduler * s)
+{
+    if (!scheduler_is_plugin(s) || !scheduler_is_plugin(scheduler) ||
+        s == scheduler) {
+        return false;
+    }
+    // dlopen hands out the same handle for the same object
+    return plugin_handles[s - plugins] == plugin_handles[scheduler - plugins];
+}
+
+/* find a built-in scheduler by name, or load a plugin if name is a path */
+static struct scheduler *
+scheduler_find(const char * name)
+{
+    struct scheduler * s = NULL;
+
+    if (strchr(name, '/') != NULL) {
+        s = scheduler_load(name);
+    } else {
+        for (int i = 0; i < num_schedulers; i++) {
+            if (strcmp(name, schedulers[i].name) == 0) {
+                s = &schedulers[i];
+                break;
+            }
+        }
+    }
+    if (s != NULL) {
+        s->timed = s->on_yield != NULL || s->on_tick != NULL ||
+                   s->on_block != NULL || s->on_wake != NULL ||
+                   s->on_exit != NULL;
+    }
+    return s;
+}
+
 /* initialize the scheduling subsystem */
 bool 
 scheduler_init(const char * name)
 {
-    scheduler = NULL;
-    for (int i = 0; i < num_schedulers; i++) {
-        if (strcmp(name, schedulers[i].name) == 0) {
-            scheduler = &schedulers[i];
-            return scheduler->init();
-        }
+    scheduler = scheduler_find(name);
+    if (scheduler != NULL) {
+        // start the clock of the hooks for the main thread
+        thread_sched_reset();
+        return scheduler->init();
     }
     
     return false;
 }
 
+/* switch to another scheduler, moving the ready threads over to it */
+int
+scheduler_switch(const char * name)
+{
+    struct scheduler * next = scheduler_find(name);
+    struct thread * head = NULL, * tail = NULL, * thread;
+    struct thread * (* drain)(void);
+    int enabled, ret;
+
+    if (next == NULL) {
+        return THREAD_INVALID;
+    }
+    enabled = interrupt_off();
+    if (next == scheduler || scheduler_loaded(next)) {
+        scheduler_unload(next);
+        interrupt_set(enabled);
+        return 0;
+    }
+    if (next->init() != 0) {
+        scheduler_unload(next);
+        interrupt_set(enabled);
+        return THREAD_NOMEMORY;
+    }
+
+    /* drain the old ready queue in its own order, linking the threads
+     * through their (now unused) next field */
+    drain = scheduler->drain != NULL ? scheduler->drain : scheduler->dequeue;
+    while ((thread = drain()) != NULL) {
+        thread->next = NULL;
+        if (tail != NULL) {
+            tail->next = thread;
+        } else {
+            head = thread;
+        }
+        tail = thread;
+    }
+    scheduler->destroy();
+    scheduler_unload(scheduler);
+    scheduler = next;
+
+    /* the old scheduler's bookkeeping means nothing to the new one */
+    thread_sched_reset();
+    while (head != NULL) {
+        thread = head;
+        head = thread->next;
+        thread->next = NULL;
+        ret = scheduler->enqueue(thread);
+        assert(ret == 0);
+    }
+    interrupt_set(enabled);
+    return 0;
+}
+
 /* clean up the scheduling subsystem */
 void 
 scheduler_end(void)
 {
     if (scheduler != NULL) {
         scheduler->destroy();
+        scheduler_unload(scheduler);
     }
     scheduler = NULL;
 }
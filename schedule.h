@@ -9,19 +9,35 @@
 #define _SCHEDULE_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 
 struct thread;
 
 #define SCHEDULERS \
     S(rand) \
-    S(fcfs) 
+    S(fcfs) \
+    S(prio) \
+    S(cfs) \
+    S(stride) \
+    S(lottery) \
+    S(mlfq) \
+    S(edf) \
+    S(ws)
 
 #define S(name) \
     int name ## _init(void); \
     int name ## _enqueue(struct thread *); \
     struct thread * name ## _dequeue(void); \
     struct thread * name ## _remove(Tid tid); \
-    void name ## _destroy(void);
+    void name ## _destroy(void); \
+    bool name ## _preempts(struct thread *, struct thread *) \
+        __attribute__((weak)); \
+    struct thread * name ## _drain(void) __attribute__((weak)); \
+    void name ## _on_yield(struct thread *, uint64_t) __attribute__((weak)); \
+    void name ## _on_tick(struct thread *, uint64_t) __attribute__((weak)); \
+    void name ## _on_block(struct thread *, uint64_t) __attribute__((weak)); \
+    void name ## _on_wake(struct thread *, uint64_t) __attribute__((weak)); \
+    void name ## _on_exit(struct thread *, uint64_t) __attribute__((weak));
     SCHEDULERS
 #undef S
 
@@ -49,8 +65,44 @@ struct scheduler {
      */
     struct thread * (* remove)(Tid tid);
     void (* destroy)(void);
+
+    /* Optional, NULL unless the scheduler defines name_preempts. Returns
+     * whether a thread that was just woken up should run before the running
+     * thread, which is then preempted. 
+     */
+    bool (* preempts)(struct thread * woken, struct thread * running);
+
+    /* Optional, NULL unless the scheduler defines name_drain. Removes any
+     * ready thread, regardless of the scheduler's policy, and returns NULL
+     * only once the ready queue is empty. scheduler_switch empties the old
+     * scheduler with it, or with dequeue if it is not set, which suits a
+     * scheduler whose dequeue may leave threads behind. 
+     */
+    struct thread * (* drain)(void);
+
+    /* Optional hooks, NULL unless the scheduler defines name_on_yield, etc.
+     * They are called with interrupts disabled, before the thread is put
+     * back in the ready queue (if at all), and are given the time in ns
+     * that the thread ran since it got the CPU, or for on_wake, that it was
+     * blocked. A thread that is neither woken up nor requeued after one of
+     * them is new. 
+     */
+    void (* on_yield)(struct thread *, uint64_t ran);    /* thread_yield */
+    void (* on_tick)(struct thread *, uint64_t ran);     /* preempted */
+    void (* on_block)(struct thread *, uint64_t ran);    /* thread_sleep */
+    void (* on_wake)(struct thread *, uint64_t slept);   /* thread_wakeup */
+    void (* on_exit)(struct thread *, uint64_t ran);     /* thread_exit */
+
+    /* whether any hook is set, in which case threads are timestamped */
+    bool timed;
 };
 
+/* A scheduler can also be loaded from a shared object, by passing its path
+ * (anything with a '/') instead of a name. The object must export a struct
+ * scheduler under this name; it can use the thread, queue and heap APIs,
+ * which the program exports when linked with -rdynamic. */
+#define SCHEDULER_PLUGIN_SYMBOL "ut369_scheduler"
+
 extern struct scheduler * scheduler;
 
 bool scheduler_init(const char *);
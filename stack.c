@@ -0,0 +1,173 @@
+/*
+ * stack.c
+ *
+ * mmap-backed, guard-paged thread stacks.
+ */
+
+#include "ut369.h"
+#include "stack.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+/* highest NUMA node that stack_bind can bind to, plus one */
+#define STACK_MAX_NODES 1024
+
+/* smallest save buffer, and the size from which one is mapped instead of
+ * taken from malloc */
+#define STACK_SAVE_MIN 256
+#define STACK_SAVE_MMAP (64 * 1024)
+
+static size_t page_size = 0;
+
+static size_t
+stack_page_size(void)
+{
+    if (page_size == 0) {
+        page_size = (size_t)sysconf(_SC_PAGESIZE);
+        assert(page_size > 0);
+    }
+    return page_size;
+}
+
+size_t
+stack_round(size_t size)
+{
+    size_t page = stack_page_size();
+
+    if (size < THREAD_SMALL_STACK) {
+        size = THREAD_SMALL_STACK;
+    }
+    return (size + page - 1) & ~(page - 1);
+}
+
+void *
+stack_alloc(size_t size)
+{
+    size_t page = stack_page_size();
+    void *stack;
+
+    assert(size % page == 0);
+    stack = mmap(NULL, size + page, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK,
+                 -1, 0);
+    if (stack == MAP_FAILED) {
+        return NULL;
+    }
+
+    // the lowest page is the guard, the stack grows down towards it
+    if (mprotect(stack, page, PROT_NONE) != 0) {
+        munmap(stack, size + page);
+        return NULL;
+    }
+    return stack;
+}
+
+void
+stack_free(void *stack, size_t size)
+{
+    int ret = munmap(stack, size + stack_page_size());
+    assert(ret == 0);
+}
+
+void *
+stack_top(void *stack, size_t size)
+{
+    return (char *)stack + stack_page_size() + size;
+}
+
+int
+stack_bind(void *stack, size_t size, int node)
+{
+    unsigned long mask[STACK_MAX_NODES / (8 * sizeof(unsigned long))] = { 0 };
+    size_t bits = 8 * sizeof(unsigned long);
+
+    if (node < 0 || node >= STACK_MAX_NODES) {
+        return -1;
+    }
+    mask[node / bits] |= 1ul << (node % bits);
+    // the kernel reads one bit less than it is told
+    if (syscall(SYS_mbind, (char *)stack + stack_page_size(), size,
+                MPOL_PREFERRED, mask, STACK_MAX_NODES + 1,
+                MPOL_MF_MOVE) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+bool
+stack_in_guard(void *stack, const void *addr)
+{
+    uintptr_t base = (uintptr_t)stack;
+    uintptr_t a = (uintptr_t)addr;
+
+    return a >= base && a < base + stack_page_size();
+}
+
+/* Capacity of the save buffer for size bytes: a power of two from
+ * STACK_SAVE_MIN for heap buffers, so that a thread whose depth varies a
+ * little keeps its buffer, or whole pages for mapped ones. */
+static size_t
+stack_save_capacity(size_t size)
+{
+    size_t page = stack_page_size();
+    size_t want = STACK_SAVE_MIN;
+
+    if (size >= STACK_SAVE_MMAP) {
+        return (size + page - 1) & ~(page - 1);
+    }
+    while (want < size) {
+        want *= 2;
+    }
+    return want;
+}
+
+void *
+stack_save_resize(void *buf, size_t *capacity, size_t size)
+{
+    size_t want = stack_save_capacity(size);
+    bool heap = want < STACK_SAVE_MMAP;
+    bool was_heap = buf == NULL || *capacity < STACK_SAVE_MMAP;
+    void *ret;
+
+    if (buf != NULL && want <= *capacity && want * 4 > *capacity) {
+        return buf;
+    }
+
+    if (heap && was_heap) {
+        ret = realloc(buf, want);
+    } else if (!heap && !was_heap) {
+        ret = mremap(buf, *capacity, want, MREMAP_MAYMOVE);
+        ret = ret == MAP_FAILED ? NULL : ret;
+    } else if (heap) {
+        ret = malloc(want);
+    } else {
+        ret = mmap(NULL, want, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        ret = ret == MAP_FAILED ? NULL : ret;
+    }
+    if (ret == NULL) {
+        return NULL;
+    }
+    // moving between heap and mapping, the old frames need not be kept
+    if (buf != NULL && heap != was_heap) {
+        stack_save_free(buf, *capacity);
+    }
+    *capacity = want;
+    return ret;
+}
+
+void
+stack_save_free(void *buf, size_t capacity)
+{
+    if (capacity < STACK_SAVE_MMAP) {
+        free(buf);
+    } else {
+        int ret = munmap(buf, capacity);
+        assert(ret == 0);
+    }
+}
@@ -0,0 +1,49 @@
+/*
+ * stack.h
+ *
+ * Allocation of thread execution stacks. Each stack is a private anonymous
+ * mapping whose pages are only committed when first touched, with a
+ * PROT_NONE guard page below the usable region so that an overflow faults
+ * instead of silently corrupting neighbouring memory.
+ */
+
+#ifndef _STACK_H_
+#define _STACK_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Round size up to a whole number of pages, and to at least
+ * THREAD_SMALL_STACK. */
+size_t stack_round(size_t size);
+
+/* Map a stack with size usable bytes (already rounded by stack_round) plus
+ * its guard page. Returns the base of the mapping, or NULL on failure. */
+void *stack_alloc(size_t size);
+
+/* Unmap a stack returned by stack_alloc with the same size. */
+void stack_free(void *stack, size_t size);
+
+/* Return the initial (highest) stack pointer of the stack. */
+void *stack_top(void *stack, size_t size);
+
+/* Ask for the pages of the stack to come from NUMA node node, moving those
+ * already committed. Returns 0, or -1 if the kernel refuses. */
+int stack_bind(void *stack, size_t size, int node);
+
+/* Return whether addr lies within the guard page of the stack. */
+bool stack_in_guard(void *stack, const void *addr);
+
+/* Resize the buffer buf of *capacity bytes (NULL and 0 for a new one) so
+ * that it holds size bytes, shrinking it when it is far larger than needed.
+ * Used to save the frames of shared-stack threads, which are usually a few
+ * hundred bytes, so small buffers come from malloc and only large ones get
+ * a mapping of their own. Like the rest of the runtime's allocations, it
+ * must be called with interrupts disabled. Returns the buffer and updates
+ * *capacity, or returns NULL and leaves buf intact. */
+void *stack_save_resize(void *buf, size_t *capacity, size_t size);
+
+/* Free a buffer returned by stack_save_resize. */
+void stack_save_free(void *buf, size_t capacity);
+
+#endif /* _STACK_H_ */
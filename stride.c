@@ -0,0 +1,78 @@
+/*
+ * stride.c
+ *
+ * Implementation of a stride scheduler. Each thread advances a virtual pass
+ * by a stride inversely proportional to its tickets every time it is picked,
+ * and the ready thread with the smallest pass runs next. Unlike a lottery,
+ * this is deterministic: over any interval, the number of times a thread is
+ * picked differs from its ticket share by at most one pick per thread.
+ */
+
+#include "ut369.h"
+#include "heap.h"
+#include "thread.h"
+#include "schedule.h"
+#include <stdint.h>
+
+/* stride of a thread with a single ticket */
+#define STRIDE_ONE (1ull << 20)
+
+static struct heap ready;
+
+/* The pass of the last thread picked. Never decreases. Threads that join
+ * the ready queue start no earlier than this, so that a thread that was
+ * blocked for a long time cannot monopolize the CPU to catch up. */
+static uint64_t global_pass;
+
+int 
+stride_init(void)
+{
+    heap_init(&ready);
+    global_pass = 0;
+    return 0;
+}
+
+int
+stride_enqueue(struct thread * thread)
+{
+    if (thread->vruntime < global_pass) {
+        thread->vruntime = global_pass;
+    }
+    thread->sched_node.key = thread->vruntime;
+    heap_insert(&ready, &thread->sched_node);
+    return 0;
+}
+
+struct thread *
+stride_dequeue(void)
+{
+    struct heap_node *node = heap_pop(&ready);
+    struct thread *ret;
+
+    if (node == NULL) {
+        return NULL;
+    }
+    ret = heap_entry(node, struct thread, sched_node);
+    global_pass = ret->vruntime;
+    /* charge the thread for the quantum it is about to get */
+    ret->vruntime += STRIDE_ONE / ret->tickets;
+    return ret;
+}
+
+struct thread *
+stride_remove(Tid tid)
+{
+    struct thread *ret = thread_get(tid);
+
+    if (ret == NULL || !heap_contains(&ready, &ret->sched_node)) {
+        return NULL;
+    }
+    heap_remove(&ready, &ret->sched_node);
+    return ret;
+}
+
+void
+stride_destroy(void)
+{
+    heap_init(&ready);
+}
@@ -0,0 +1,122 @@
+#include "test.h"
+#include <time.h>
+
+#define QUANTUM_MIN 500
+#define QUANTUM_MAX 8000
+#define OWN_QUANTUM 2000
+#define NR_HOGS 8
+#define HOG_USECS 200000
+
+static long slices[NR_HOGS];
+static long sliced_usecs[NR_HOGS];
+static volatile long turn = -1;     /* the hog that ran last */
+
+/* CPU time of the kernel thread, which all the hogs share. Unlike wall time,
+ * it does not count the time that the kernel gives to other processes, so a
+ * slice can only look shorter when they compete for the CPU. */
+static long
+now_usecs(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+	return now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/* spins for HOG_USECS, and measures how long it runs between the turns of
+ * the other hogs. A gap in which the kernel runs another process does not
+ * end a slice. */
+static int
+test_hog(long id)
+{
+	long start = now_usecs();
+	long slice_start = start, last = start;
+
+	turn = id;
+	while (last - start < HOG_USECS) {
+		long now = now_usecs();
+		if (turn != id) {
+			turn = id;
+			slices[id]++;
+			sliced_usecs[id] += last - slice_start;
+			/* the other hog may have run since now was read */
+			now = now_usecs();
+			slice_start = now;
+		}
+		last = now;
+	}
+	return 0;
+}
+
+/* same, but with a quantum of its own */
+static int
+test_own_hog(long id)
+{
+	assert(thread_set_quantum(thread_id(), OWN_QUANTUM) == 0);
+	assert(thread_get_quantum(thread_id()) == OWN_QUANTUM);
+	return test_hog(id);
+}
+
+/* runs nr hogs, the first one being hog, and returns their average slice in
+ * usecs, or that of the first one if first_only is set */
+static long
+test_run(int nr, thread_entry_f hog, int first_only)
+{
+	Tid tids[NR_HOGS];
+	long total_slices = 0, total_usecs = 0;
+
+	turn = -1;
+	for (long i = 0; i < nr; i++) {
+		slices[i] = 0;
+		sliced_usecs[i] = 0;
+		tids[i] = thread_create(i == 0 ? hog : (thread_entry_f)test_hog,
+		                        (void *)i);
+		assert(thread_ret_ok(tids[i]));
+	}
+	for (int i = 0; i < nr; i++) {
+		assert(thread_wait(tids[i], NULL) == tids[i]);
+		if (i == 0 || !first_only) {
+			total_slices += slices[i];
+			total_usecs += sliced_usecs[i];
+		}
+	}
+	assert(total_slices > 0);
+	return total_usecs / total_slices;
+}
+
+int
+main()
+{
+	long few, many, own;
+
+	printf("starting adaptive test\n");
+
+	struct config config = {
+		.sched_name = "fcfs", .preemptive = true, .verbose = false,
+		.quantum_min = QUANTUM_MIN, .quantum_max = QUANTUM_MAX
+	};
+	ut369_start(&config);
+
+	/* with one thread waiting, the slices are as long as they get. Another
+	 * process may take up to about half of each one. */
+	few = test_run(2, (thread_entry_f)test_hog, 0);
+	unintr_printf("2 hogs: %s\n", few > QUANTUM_MAX / 4 ?
+	              "long slices" : "short slices");
+	assert(few > QUANTUM_MAX / 4);
+
+	/* with seven, they shrink so that each hog gets the CPU sooner */
+	many = test_run(NR_HOGS, (thread_entry_f)test_hog, 0);
+	unintr_printf("%d hogs: %s\n", NR_HOGS, many < few / 2 ?
+	              "shorter slices" : "slices as long");
+	assert(many < few / 2);
+
+	/* a quantum of its own overrides the adaptive one */
+	own = test_run(2, (thread_entry_f)test_own_hog, 1);
+	unintr_printf("own quantum: %s\n", own < OWN_QUANTUM * 2 ?
+	              "kept" : "ignored");
+	assert(own < OWN_QUANTUM * 2);
+	assert(thread_set_quantum(THREAD_NONE, 0) == THREAD_INVALID);
+
+	printf("adaptive test done\n");
+	return 0;
+}
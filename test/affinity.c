@@ -0,0 +1,76 @@
+#include "test.h"
+#include <sched.h>
+
+#define NR_CARRIERS 2
+#define BARRIER_USECS 10000000
+
+/* both carriers on CPU 0, which always exists */
+static const int cpus[NR_CARRIERS] = { 0, 0 };
+static int arrived;
+
+/* return whether the calling kernel thread may only run on CPU 0 */
+static int
+pinned(void)
+{
+	cpu_set_t set;
+
+	assert(sched_getaffinity(0, sizeof(set), &set) == 0);
+	return CPU_COUNT(&set) == 1 && CPU_ISSET(0, &set);
+}
+
+/* runs on the other carrier, since the main thread spins on its own */
+static int
+test_affinity_other(void)
+{
+	struct timeval start, now, diff;
+	int ret = pinned() ? 0 : -1;
+
+	__atomic_add_fetch(&arrived, 1, __ATOMIC_SEQ_CST);
+	gettimeofday(&start, NULL);
+	while (__atomic_load_n(&arrived, __ATOMIC_SEQ_CST) < NR_CARRIERS) {
+		gettimeofday(&now, NULL);
+		timersub(&now, &start, &diff);
+		if (diff.tv_sec * 1000000 + diff.tv_usec > BARRIER_USECS) {
+			return -1;
+		}
+	}
+	return ret;
+}
+
+int
+main()
+{
+	unsigned int cpu, node;
+	int exit_code;
+	Tid tid;
+
+	printf("starting affinity test\n");
+
+	struct config config = {
+		.sched_name = "ws", .preemptive = false, .verbose = false,
+		.carriers = NR_CARRIERS, .cpus = cpus
+	};
+	ut369_start(&config);
+
+	assert(pinned());
+	assert(getcpu(&cpu, &node) == 0 && cpu == 0);
+
+	tid = thread_create((thread_entry_f)test_affinity_other, NULL);
+	assert(thread_ret_ok(tid));
+	/* the stack is put on the node of the carrier that creates it, unless
+	 * the kernel does not let us choose */
+	int enabled = interrupt_off();
+	int stack_node = thread_get(tid)->node;
+	interrupt_set(enabled);
+	assert(stack_node == (int)node || stack_node == -1);
+	printf("stack %s on the creating carrier's node\n",
+	       stack_node == (int)node ? "is" : "could not be put");
+
+	assert(test_affinity_other() == 0);
+	assert(thread_wait(tid, &exit_code) == tid);
+	assert(exit_code == 0);
+	printf("all carriers are pinned\n");
+
+	printf("affinity test done\n");
+	return 0;
+}
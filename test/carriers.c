@@ -0,0 +1,127 @@
+#include "test.h"
+#include <string.h>
+
+#define NR_CARRIERS 4
+#define NR_WORKERS 16
+#define NR_ROUNDS 2000
+#define NR_PINGS 1000
+#define BARRIER_USECS 10000000
+
+static struct lock *lock;
+static struct cv *cv;
+static long counter;
+static int arrived;
+static int turn;
+
+/* spins without ever yielding until a thread runs on each carrier, which
+ * only happens if the carriers really run them side by side */
+static int
+test_barrier(void)
+{
+	struct timeval start, now, diff;
+
+	__atomic_add_fetch(&arrived, 1, __ATOMIC_SEQ_CST);
+	gettimeofday(&start, NULL);
+	while (__atomic_load_n(&arrived, __ATOMIC_SEQ_CST) < NR_CARRIERS) {
+		gettimeofday(&now, NULL);
+		timersub(&now, &start, &diff);
+		if (diff.tv_sec * 1000000 + diff.tv_usec > BARRIER_USECS) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* a read-modify-write of counter that is only atomic thanks to lock, with
+ * yields in the middle so that the others pile up on the lock */
+static int
+test_counter(long id)
+{
+	for (int i = 0; i < NR_ROUNDS; i++) {
+		assert(lock_acquire(lock) == 0);
+		long value = counter;
+		if (i % 7 == 0) {
+			thread_yield(THREAD_ANY);
+		}
+		counter = value + 1;
+		lock_release(lock);
+	}
+	return (int)id;
+}
+
+/* takes turns with its peer through cv */
+static int
+test_ping(long me)
+{
+	assert(lock_acquire(lock) == 0);
+	for (int i = 0; i < NR_PINGS; i++) {
+		while (turn != me) {
+			assert(cv_wait(cv) == 0);
+		}
+		turn = !me;
+		cv_broadcast(cv);
+	}
+	lock_release(lock);
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	Tid tids[NR_WORKERS];
+	int exit_code;
+
+	struct config config = {
+		.sched_name = "fcfs", .preemptive = false, .verbose = false,
+		.carriers = NR_CARRIERS
+	};
+	if (argc > 1 && strcmp(argv[1], "preemptive") == 0) {
+		config.preemptive = true;
+	}
+	printf("starting carriers test (%s)\n",
+	       config.preemptive ? "preemptive" : "cooperative");
+	ut369_start(&config);
+
+	lock = lock_create();
+	assert(lock != NULL);
+	cv = cv_create(lock);
+	assert(cv != NULL);
+
+	struct thread_attr attr = { .shared_stack = true };
+	assert(thread_create_attr((thread_entry_f)test_barrier, NULL, &attr) ==
+	       THREAD_INVALID);
+
+	for (int i = 0; i < NR_CARRIERS - 1; i++) {
+		tids[i] = thread_create((thread_entry_f)test_barrier, NULL);
+		assert(thread_ret_ok(tids[i]));
+	}
+	assert(test_barrier() == 0);
+	for (int i = 0; i < NR_CARRIERS - 1; i++) {
+		assert(thread_wait(tids[i], &exit_code) == tids[i]);
+		assert(exit_code == 0);
+	}
+	unintr_printf("all %d carriers ran at once\n", NR_CARRIERS);
+
+	for (long i = 0; i < NR_WORKERS; i++) {
+		tids[i] = thread_create((thread_entry_f)test_counter, (void *)i);
+		assert(thread_ret_ok(tids[i]));
+	}
+	for (int i = 0; i < NR_WORKERS; i++) {
+		assert(thread_wait(tids[i], &exit_code) == tids[i]);
+		assert(exit_code == i);
+	}
+	assert(counter == NR_WORKERS * NR_ROUNDS);
+	unintr_printf("counter is %ld\n", counter);
+
+	tids[0] = thread_create((thread_entry_f)test_ping, (void *)0);
+	tids[1] = thread_create((thread_entry_f)test_ping, (void *)1);
+	assert(thread_ret_ok(tids[0]) && thread_ret_ok(tids[1]));
+	assert(thread_wait(tids[0], NULL) == tids[0]);
+	assert(thread_wait(tids[1], NULL) == tids[1]);
+	unintr_printf("%d pings\n", NR_PINGS);
+
+	cv_destroy(cv);
+	lock_destroy(lock);
+	printf("carriers test done\n");
+	return 0;
+}
@@ -0,0 +1,83 @@
+#include "test.h"
+
+#define DURATION 1000000 /* usecs */
+#define NTHREADS 4
+
+static volatile int stop;
+static volatile long work[NTHREADS];
+
+/* burn CPU, counting the work done */
+static int
+test_cfs_hog(int num)
+{
+	while (!stop) {
+		work[num]++;
+	}
+	return num;
+}
+
+/* same as a hog, but gives up the CPU early every 50 usecs */
+static int
+test_cfs_yielder(int num)
+{
+	while (!stop) {
+		struct timeval start, now, diff;
+		gettimeofday(&start, NULL);
+		do {
+			work[num]++;
+			gettimeofday(&now, NULL);
+			timersub(&now, &start, &diff);
+		} while (diff.tv_usec < 50 && !stop);
+		thread_yield(THREAD_ANY);
+	}
+	return num;
+}
+
+int
+main()
+{
+	Tid child[NTHREADS];
+	double ratio;
+	int ii;
+
+	printf("starting cfs test\n");
+
+	struct config config = {
+		.sched_name = "cfs", .preemptive = true, .verbose = false
+	};
+	ut369_start(&config);
+
+	/* 0 and 1 are hogs, 2 and 3 yield early; 1 and 3 have twice the
+	 * weight of the others */
+	child[0] = thread_create((thread_entry_f)test_cfs_hog, (void *)0);
+	child[1] = thread_create((thread_entry_f)test_cfs_hog, (void *)1);
+	child[2] = thread_create((thread_entry_f)test_cfs_yielder, (void *)2);
+	child[3] = thread_create((thread_entry_f)test_cfs_yielder, (void *)3);
+	for (ii = 0; ii < NTHREADS; ii++) {
+		assert(thread_ret_ok(child[ii]));
+		int prio = (ii % 2) ? THREAD_PRIO_DEFAULT - 3 : THREAD_PRIO_DEFAULT;
+		assert(thread_setprio(child[ii], prio) == 0);
+	}
+
+	/* the main thread gets a tiny weight, so it barely competes */
+	assert(thread_setprio(thread_id(), THREAD_PRIO_LEVELS - 1) == 0);
+	spin(DURATION);
+	stop = 1;
+
+	for (ii = 0; ii < NTHREADS; ii++) {
+		assert(thread_wait(child[ii], NULL) == child[ii]);
+	}
+
+	/* a weight of 1991 against 1024 should get about twice the CPU, for
+	 * threads doing the same kind of work */
+	ratio = (double)work[1] / work[0];
+	printf("hog share ratio: %s\n", ratio > 1.4 && ratio < 2.8 ? "ok" : "bad");
+	assert(ratio > 1.4 && ratio < 2.8);
+	ratio = (double)work[3] / work[2];
+	printf("yielder share ratio: %s\n",
+	       ratio > 1.4 && ratio < 2.8 ? "ok" : "bad");
+	assert(ratio > 1.4 && ratio < 2.8);
+
+	printf("cfs test done\n");
+	return 0;
+}
@@ -180,6 +180,35 @@ test_wakeup_interrupt_enabled(void)
     return 0;
 }
 
+static volatile long recurse_limit = -1;
+
+static int
+recurse_forever(void *arg)
+{
+    volatile char frame[256];
+    long depth = (long)arg;
+
+    frame[0] = (char)depth;
+    if (depth == recurse_limit) {
+        return 0;
+    }
+    return recurse_forever((void *)(depth + 1)) + frame[0];
+}
+
+int
+test_create_stack_overflow(void)
+{
+    struct thread_attr attr = { .stack_size = THREAD_SMALL_STACK };
+    Tid tid = thread_create_attr(recurse_forever, NULL, &attr);
+    thread_expect(thread_ret_ok(tid));
+
+    // Should just crash here, when the new thread hits its guard page
+    thread_wait(tid, NULL);
+
+    // Test failed if it didn't crash
+    return 0;
+}
+
 testcase_t test_case[] = {
     { "Lock Destroy - Held by thread", test_lock_destroy_held_by_thread },
     { "Lock Destroy - CV associated", test_lock_destroy_cv_associated },
@@ -189,6 +218,7 @@ testcase_t test_case[] = {
     { "CV Destroy - Queue not empty", test_cv_wait_queue_not_empty },
     { "Thread Sleep - Interrupt enabled", test_sleep_interrupt_enabled },
     { "Thread Wakeup - Interrupt enabled", test_wakeup_interrupt_enabled },
+    { "Thread Create - Stack overflow", test_create_stack_overflow },
 };
 
 int nr_cases = sizeof(test_case) / sizeof(struct _tc);
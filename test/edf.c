@@ -0,0 +1,151 @@
+#include "test.h"
+#include <time.h>
+
+#define NTHREADS 4
+#define NWAKEUPS 1000
+#define MSEC 1000000ull
+
+static const int due[NTHREADS] = { 4, 1, 3, 2 }; /* in secs from now */
+static int order[NTHREADS];
+static int nr_run;
+
+static fifo_queue_t *queue;
+static volatile int nr_woken;
+static volatile int stop;
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int
+test_edf_thread(int num)
+{
+	order[nr_run++] = num;
+	return num;
+}
+
+/* runs past its own deadline without giving up the CPU, then exits */
+static int
+test_edf_late(int num)
+{
+	uint64_t deadline = now_ns() + MSEC;
+	int enabled;
+
+	assert(thread_set_deadline(thread_id(), deadline) == 0);
+	enabled = interrupt_off();
+	while (now_ns() <= deadline + MSEC) {
+	}
+	interrupt_set(enabled);
+	return num;
+}
+
+/* sleeps until woken, then sets a deadline for the next wakeup */
+static int
+test_edf_worker(void)
+{
+	while (1) {
+		int enabled = interrupt_off();
+		int ret = thread_sleep(queue);
+		assert(thread_ret_ok(ret));
+		interrupt_set(enabled);
+		if (stop) {
+			return 0;
+		}
+		nr_woken++;
+		assert(thread_set_deadline(thread_id(), now_ns() + 10 * MSEC) ==
+		       0);
+	}
+}
+
+int
+main()
+{
+	Tid child[NTHREADS], worker;
+	uint64_t start;
+	int ii;
+
+	printf("starting edf test\n");
+
+	struct config config = {
+		.sched_name = "edf", .preemptive = true, .verbose = false
+	};
+	ut369_start(&config);
+
+	assert(thread_set_deadline(THREAD_MAX_THREADS + 1000, 1) ==
+	       THREAD_INVALID);
+	assert(thread_set_deadline(-42, 1) == THREAD_INVALID);
+	assert(thread_deadline_misses() == 0);
+
+	/* run first while creating the children, then behind all of them */
+	start = now_ns();
+	assert(thread_set_deadline(thread_id(), start + 100 * MSEC) == 0);
+	for (ii = 0; ii < NTHREADS; ii++) {
+		child[ii] = thread_create((thread_entry_f)test_edf_thread,
+		                          (void *)(long)ii);
+		assert(thread_ret_ok(child[ii]));
+		assert(thread_set_deadline(child[ii],
+		                           start + due[ii] * 1000 * MSEC) == 0);
+	}
+	assert(thread_set_deadline(thread_id(), 0) == 0);
+	thread_yield(THREAD_ANY);
+	assert(nr_run == NTHREADS);
+	for (ii = 0; ii < NTHREADS; ii++) {
+		assert(thread_wait(child[ii], NULL) == child[ii]);
+	}
+	for (ii = 1; ii < NTHREADS; ii++) {
+		assert(due[order[ii - 1]] < due[order[ii]]);
+	}
+	printf("earliest deadline first: ok\n");
+	assert(thread_deadline_misses() == 0);
+
+	/* a thread that gets the CPU late counts as a miss, once */
+	child[0] = thread_create((thread_entry_f)test_edf_thread, (void *)0);
+	assert(thread_ret_ok(child[0]));
+	assert(thread_set_deadline(child[0], now_ns() - MSEC) == 0);
+	assert(thread_wait(child[0], NULL) == child[0]);
+	assert(thread_deadline_misses() == 1);
+	assert(thread_set_deadline(thread_id(), now_ns() - MSEC) == 0);
+	assert(thread_set_deadline(thread_id(), 0) == 0);
+	assert(thread_deadline_misses() == 2);
+
+	/* and so does one that exits late */
+	child[0] = thread_create((thread_entry_f)test_edf_late, (void *)0);
+	assert(thread_ret_ok(child[0]));
+	assert(thread_wait(child[0], NULL) == child[0]);
+	assert(thread_deadline_misses() == 3);
+	printf("deadline misses: ok\n");
+
+	/* the worker has a deadline and the main thread does not, so waking
+	 * it up must hand it the CPU right away */
+	queue = queue_create(THREAD_MAX_THREADS);
+	assert(queue != NULL);
+	worker = thread_create((thread_entry_f)test_edf_worker, NULL);
+	assert(thread_ret_ok(worker));
+	assert(thread_set_deadline(worker, now_ns() + 10 * MSEC) == 0);
+	thread_yield(worker);
+	for (ii = 0; ii < NWAKEUPS; ii++) {
+		int enabled;
+
+		spin(20);
+		enabled = interrupt_off();
+		assert(thread_wakeup(queue, 0) == 1);
+		interrupt_set(enabled);
+		assert(nr_woken == ii + 1);
+	}
+	printf("wakeup preemption: ok\n");
+
+	stop = 1;
+	interrupt_off();
+	assert(thread_wakeup(queue, 0) == 1);
+	interrupt_on();
+	assert(thread_wait(worker, NULL) == worker);
+	queue_destroy(queue);
+	assert(thread_deadline_misses() == 3);
+
+	printf("edf test done\n");
+	return 0;
+}
@@ -0,0 +1,67 @@
+#include "test.h"
+
+static int
+test_handle_thread(int num)
+{
+	while (1) {
+		thread_yield(THREAD_ANY);
+	}
+	return num;
+}
+
+int
+main()
+{
+	Tid tid, ret;
+	thread_handle_t old, new;
+	int exitcode;
+
+	printf("starting handle test\n");
+
+	struct config config = {
+		.sched_name = "fcfs", .preemptive = false, .verbose = false
+	};
+	ut369_start(&config);
+
+	old = thread_handle(thread_id());
+	assert(old != 0);
+	assert(thread_handle_tid(old) == thread_id());
+	assert(thread_handle(THREAD_MAX_THREADS + 1000) == 0);
+	assert(thread_handle_tid(0) == THREAD_INVALID);
+
+	/* a handle stays valid for a thread until it is reaped */
+	tid = thread_create((thread_entry_f)test_handle_thread, (void *)1);
+	assert(thread_ret_ok(tid));
+	old = thread_handle(tid);
+	assert(thread_handle_tid(old) == tid);
+	ret = thread_yield_handle(old);
+	assert(ret == tid);
+	ret = thread_kill_handle(old);
+	assert(ret == tid);
+	ret = thread_wait_handle(old, &exitcode);
+	assert(ret == tid);
+	assert(exitcode == THREAD_KILLED);
+	assert(thread_handle_tid(old) == THREAD_INVALID);
+
+	/* the new thread reuses the Tid, but not the handle */
+	ret = thread_create((thread_entry_f)test_handle_thread, (void *)2);
+	assert(ret == tid);
+	new = thread_handle(tid);
+	assert(new != old);
+	assert(thread_kill_handle(old) == THREAD_INVALID);
+	assert(thread_yield_handle(old) == THREAD_INVALID);
+	assert(thread_wait_handle(old, NULL) == THREAD_INVALID);
+
+	/* ... and the stale calls above did not touch the new thread */
+	ret = thread_yield_handle(new);
+	assert(ret == tid);
+	ret = thread_kill_handle(new);
+	assert(ret == tid);
+	ret = thread_wait_handle(new, &exitcode);
+	assert(ret == tid);
+	assert(exitcode == THREAD_KILLED);
+
+	printf("handle test done\n");
+	thread_exit(0);
+	return 0;
+}
@@ -0,0 +1,117 @@
+#include "test.h"
+#include "plugins/hooks.h"
+#include <dlfcn.h>
+#include <string.h>
+#include <libgen.h>
+#include <limits.h>
+#include <time.h>
+
+#define MSEC 1000000ull
+#define RUN_NS (50 * MSEC)    /* the sleeper runs this long first */
+#define SLEEP_NS (20 * MSEC)  /* then sleeps this long */
+
+static struct hooks_log *hooks_log;
+static fifo_queue_t *queue;
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void
+spin_ns(uint64_t ns)
+{
+	uint64_t end = now_ns() + ns;
+	while (now_ns() < end);
+}
+
+/* runs, sleeps, runs again and yields, then runs and exits */
+static int
+test_hooks_thread(int num)
+{
+	int enabled;
+
+	spin_ns(RUN_NS);
+	enabled = interrupt_off();
+	assert(thread_ret_ok(thread_sleep(queue)));
+	interrupt_set(enabled);
+
+	spin_ns(MSEC);
+	thread_yield(THREAD_ANY);
+	spin_ns(MSEC);
+	return num;
+}
+
+int
+main(int argc, const char * argv[])
+{
+	char dir[PATH_MAX], path[PATH_MAX];
+	uint64_t start;
+	void *handle;
+	Tid tid;
+	int exitcode;
+
+	(void)argc;
+	printf("starting hooks test\n");
+
+	/* the plugin is built next to this program */
+	strncpy(dir, argv[0], sizeof(dir) - 1);
+	dir[sizeof(dir) - 1] = '\0';
+	snprintf(path, sizeof(path), "%s/plugins/hooks.so", dirname(dir));
+
+	struct config config = {
+		.sched_name = path, .preemptive = false, .verbose = false
+	};
+	ut369_start(&config);
+
+	/* the scheduler has the plugin loaded already */
+	handle = dlopen(path, RTLD_NOW | RTLD_NOLOAD);
+	assert(handle != NULL);
+	hooks_log = dlsym(handle, HOOKS_LOG_SYMBOL);
+	assert(hooks_log != NULL);
+	queue = queue_create(THREAD_MAX_THREADS);
+	assert(queue != NULL);
+
+	tid = thread_create((thread_entry_f)test_hooks_thread, (void *)42);
+	assert(thread_ret_ok(tid));
+	assert(thread_yield(tid) == tid);
+	assert(hooks_log->yield.count == 1);
+	assert(hooks_log->yield.tid == thread_id());
+
+	/* the sleep is timed from when the thread blocked, not from when it
+	 * last got the CPU, although there is no on_block hook */
+	spin_ns(SLEEP_NS);
+	interrupt_off();
+	assert(thread_wakeup(queue, 0) == 1);
+	interrupt_on();
+	assert(hooks_log->wake.count == 1);
+	assert(hooks_log->wake.tid == tid);
+	unintr_printf("slept for %llu ms\n",
+	              (unsigned long long)(hooks_log->wake.ns / MSEC));
+	assert(hooks_log->wake.ns >= SLEEP_NS);
+	assert(hooks_log->wake.ns < SLEEP_NS + RUN_NS);
+
+	/* a yield and an exit each report a run no longer than it took */
+	start = now_ns();
+	assert(thread_yield(tid) == tid);
+	assert(hooks_log->yield.count == 3);
+	assert(hooks_log->yield.tid == tid);
+	assert(hooks_log->yield.ns > 0);
+	assert(hooks_log->yield.ns <= now_ns() - start);
+
+	start = now_ns();
+	assert(thread_yield(tid) == tid);
+	assert(hooks_log->exit.count == 1);
+	assert(hooks_log->exit.tid == tid);
+	assert(hooks_log->exit.ns > 0);
+	assert(hooks_log->exit.ns <= now_ns() - start);
+	assert(thread_wait(tid, &exitcode) == tid);
+	assert(exitcode == 42);
+
+	queue_destroy(queue);
+	printf("hooks test done\n");
+	return 0;
+}
@@ -0,0 +1,91 @@
+#include "test.h"
+
+#define NTHREADS 8
+#define NHOGS 4
+#define NSWITCHES 2000
+
+static const char *names[] = {
+	"rand", "fcfs", "prio", "cfs", "stride", "lottery", "mlfq", "edf", "ws"
+};
+#define NNAMES ((int)(sizeof(names) / sizeof(names[0])))
+
+static const int prio[NTHREADS] = { 20, 3, 20, 0, 31, 3, 7, 16 };
+static int order[NTHREADS];
+static int nr_run;
+static volatile int stop;
+
+static int
+test_hotswap_thread(int num)
+{
+	order[nr_run++] = num;
+	return num;
+}
+
+static int
+test_hotswap_hog(int num)
+{
+	while (!stop);
+	return num;
+}
+
+int
+main()
+{
+	Tid child[NTHREADS];
+	int ii;
+
+	printf("starting hotswap test\n");
+
+	struct config config = {
+		.sched_name = "fcfs", .preemptive = true, .verbose = false
+	};
+	ut369_start(&config);
+
+	assert(scheduler_switch("nosuchsched") == THREAD_INVALID);
+	assert(scheduler_switch("fcfs") == 0);
+
+	/* threads made ready under fcfs run in priority order after the
+	 * switch to prio */
+	interrupt_off();
+	assert(thread_setprio(thread_id(), THREAD_PRIO_LEVELS - 1) == 0);
+	for (ii = 0; ii < NTHREADS; ii++) {
+		child[ii] = thread_create((thread_entry_f)test_hotswap_thread,
+		                          (void *)(long)ii);
+		assert(thread_ret_ok(child[ii]));
+		assert(thread_setprio(child[ii], prio[ii]) == 0);
+	}
+	assert(scheduler_switch("prio") == 0);
+	interrupt_on();
+	while (thread_yield(THREAD_ANY) != THREAD_NONE);
+	assert(nr_run == NTHREADS);
+	for (ii = 1; ii < NTHREADS; ii++) {
+		assert(prio[order[ii - 1]] <= prio[order[ii]]);
+		if (prio[order[ii - 1]] == prio[order[ii]]) {
+			assert(order[ii - 1] < order[ii]);
+		}
+	}
+	for (ii = 0; ii < NTHREADS; ii++) {
+		assert(thread_wait(child[ii], NULL) == child[ii]);
+	}
+	assert(thread_setprio(thread_id(), THREAD_PRIO_DEFAULT) == 0);
+	printf("ready threads migrated: ok\n");
+
+	/* switch back and forth while the timer preempts the hogs */
+	for (ii = 0; ii < NHOGS; ii++) {
+		child[ii] = thread_create((thread_entry_f)test_hotswap_hog,
+		                          (void *)(long)ii);
+		assert(thread_ret_ok(child[ii]));
+	}
+	for (ii = 0; ii < NSWITCHES; ii++) {
+		assert(scheduler_switch(names[ii % NNAMES]) == 0);
+		thread_yield(THREAD_ANY);
+	}
+	stop = 1;
+	for (ii = 0; ii < NHOGS; ii++) {
+		assert(thread_wait(child[ii], NULL) == child[ii]);
+	}
+	printf("switches under load: ok\n");
+
+	printf("hotswap test done\n");
+	return 0;
+}
@@ -0,0 +1,154 @@
+#include "test.h"
+
+#define HOG_USECS 2000000
+
+static struct lock *lock_a, *lock_b;
+static volatile int stop;
+static volatile int hog_done;
+static int low_prio_seen, mid_prio_seen;
+static int holder_prio_seen;
+
+/* holds lock_b, and only gets the CPU back if it inherits a priority above
+ * that of the hog */
+static int
+test_inherit_low(void)
+{
+	assert(lock_acquire(lock_b) == 0);
+	thread_yield(THREAD_ANY);
+	low_prio_seen = thread_getprio(thread_id());
+	lock_release(lock_b);
+	return 0;
+}
+
+/* holds lock_a while waiting for lock_b */
+static int
+test_inherit_mid(void)
+{
+	assert(lock_acquire(lock_a) == 0);
+	assert(lock_acquire(lock_b) == 0);
+	mid_prio_seen = thread_getprio(thread_id());
+	lock_release(lock_b);
+	lock_release(lock_a);
+	return 0;
+}
+
+/* waits for lock_a, and holds it until stop is set */
+static int
+test_inherit_waiter(void)
+{
+	assert(lock_acquire(lock_a) == 0);
+	holder_prio_seen = thread_getprio(thread_id());
+	while (!stop) {
+		thread_yield(THREAD_ANY);
+	}
+	lock_release(lock_a);
+	return 0;
+}
+
+/* keeps the CPU away from any less urgent thread for a while */
+static int
+test_inherit_hog(void)
+{
+	struct timeval start, now, diff;
+
+	gettimeofday(&start, NULL);
+	do {
+		gettimeofday(&now, NULL);
+		timersub(&now, &start, &diff);
+	} while (!stop && diff.tv_sec * 1000000 + diff.tv_usec < HOG_USECS);
+	hog_done = 1;
+	return 0;
+}
+
+int
+main()
+{
+	Tid low, mid, hog;
+
+	printf("starting inherit test\n");
+
+	struct config config = {
+		.sched_name = "prio", .preemptive = true, .verbose = false
+	};
+	ut369_start(&config);
+
+	lock_a = lock_create();
+	lock_b = lock_create();
+	assert(lock_a != NULL && lock_b != NULL);
+
+	/* the main thread is the most urgent, and sets things up so that
+	 * low holds lock_b, mid holds lock_a and waits for lock_b */
+	assert(thread_setprio(thread_id(), 0) == 0);
+	low = thread_create((thread_entry_f)test_inherit_low, NULL);
+	assert(thread_ret_ok(low));
+	assert(thread_setprio(low, 30) == 0);
+	assert(thread_yield(low) == low);
+
+	mid = thread_create((thread_entry_f)test_inherit_mid, NULL);
+	assert(thread_ret_ok(mid));
+	assert(thread_setprio(mid, 20) == 0);
+	assert(thread_yield(mid) == mid);
+	assert(thread_getprio(mid) == 20);
+	assert(thread_getprio(low) == 20);
+
+	/* without inheritance, the hog would keep low and then mid from
+	 * running, and so keep the main thread waiting for lock_a */
+	hog = thread_create((thread_entry_f)test_inherit_hog, NULL);
+	assert(thread_ret_ok(hog));
+	assert(thread_setprio(hog, 10) == 0);
+	assert(lock_acquire(lock_a) == 0);
+	assert(!hog_done);
+	assert(low_prio_seen == 0);
+	assert(mid_prio_seen == 0);
+	printf("transitive inheritance: ok\n");
+
+	/* the priorities are given back with the locks */
+	assert(thread_getprio(mid) == 20);
+	assert(thread_getprio(low) == 30);
+	assert(thread_getprio(thread_id()) == 0);
+	printf("priorities restored: ok\n");
+
+	lock_release(lock_a);
+	stop = 1;
+	assert(thread_wait(low, NULL) == low);
+	assert(thread_wait(mid, NULL) == mid);
+	assert(thread_wait(hog, NULL) == hog);
+	stop = 0;
+
+	/* w20 and then w10 wait for lock_a: releasing it wakes w10, the most
+	 * urgent one, which then inherits from w20 once it holds the lock */
+	Tid w20, w10;
+	int exit_code;
+	assert(lock_acquire(lock_a) == 0);
+	w20 = thread_create((thread_entry_f)test_inherit_waiter, NULL);
+	w10 = thread_create((thread_entry_f)test_inherit_waiter, NULL);
+	assert(thread_ret_ok(w20) && thread_ret_ok(w10));
+	assert(thread_setprio(w20, 20) == 0);
+	assert(thread_setprio(w10, 10) == 0);
+	assert(thread_yield(w20) == w20);
+	assert(thread_yield(w10) == w10);
+	lock_release(lock_a);
+	assert(thread_setprio(w20, 0) == 0);
+	assert(thread_yield(w10) == w10);
+	assert(holder_prio_seen == 0);
+	printf("handoff to the most urgent waiter: ok\n");
+
+	/* the holder follows the priority of the thread still waiting */
+	assert(thread_setprio(w20, 20) == 0);
+	assert(thread_getprio(w10) == 10);
+	assert(thread_setprio(w20, 5) == 0);
+	assert(thread_getprio(w10) == 5);
+	assert(thread_kill(w20) == w20);
+	assert(thread_getprio(w10) == 10);
+	printf("waiter priority changes: ok\n");
+
+	stop = 1;
+	assert(thread_wait(w10, NULL) == w10);
+	assert(thread_wait(w20, &exit_code) == w20);
+	assert(exit_code == THREAD_KILLED);
+	lock_destroy(lock_a);
+	lock_destroy(lock_b);
+
+	printf("inherit test done\n");
+	return 0;
+}
@@ -0,0 +1,69 @@
+#include "test.h"
+#include "../carrier.h"
+
+#define NR_CARRIERS 4
+#define NR_WORKERS 8
+#define NR_ROUNDS 200000
+#define QUANTUM 100
+
+static long counter;
+static long moves;
+
+/* turns interrupts off and on all the time, so that ticks land right before
+ * and after the carrier it runs on is disabled, and it is moved to another
+ * carrier in between */
+static int
+test_worker(void)
+{
+	struct carrier *last = NULL;
+
+	for (int i = 0; i < NR_ROUNDS; i++) {
+		int enabled = interrupt_off();
+		struct carrier *c = carrier_self();
+		assert(enabled);
+		assert(!interrupt_enabled());
+		// interrupts must be disabled on the carrier the thread is on
+		assert(c->current == thread_current());
+		counter++;
+		if (last != NULL && c != last) {
+			moves++;
+		}
+		last = c;
+		interrupt_set(enabled);
+	}
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	Tid tids[NR_WORKERS];
+	int nr_carriers = argc > 1 ? atoi(argv[1]) : NR_CARRIERS;
+
+	if (nr_carriers < 1) {
+		fprintf(stderr, "usage: %s [carriers]\n", argv[0]);
+		exit(1);
+	}
+	printf("starting migrate test (%d carriers)\n", nr_carriers);
+
+	struct config config = {
+		.sched_name = "fcfs", .preemptive = true, .verbose = false,
+		.carriers = nr_carriers, .quantum = QUANTUM
+	};
+	ut369_start(&config);
+
+	for (int i = 0; i < NR_WORKERS; i++) {
+		tids[i] = thread_create((thread_entry_f)test_worker, NULL);
+		assert(thread_ret_ok(tids[i]));
+	}
+	for (int i = 0; i < NR_WORKERS; i++) {
+		assert(thread_wait(tids[i], NULL) == tids[i]);
+	}
+	assert(counter == (long)NR_WORKERS * NR_ROUNDS);
+	unintr_printf("counter is %ld, threads %s carriers\n", counter,
+	              moves > 0 || nr_carriers == 1 ? "moved between" :
+	              "stayed on their");
+
+	printf("migrate test done\n");
+	return 0;
+}
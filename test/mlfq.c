@@ -0,0 +1,90 @@
+#include "test.h"
+
+#define NHOGS 4
+#define NROUNDS 500
+
+static volatile int stop;
+
+/* burn CPU until told to stop */
+static int
+test_mlfq_hog(int num)
+{
+	while (!stop);
+	return num;
+}
+
+/* an interactive thread: runs briefly, then gives up the CPU, and returns
+ * the mean time in usecs it took to get it back */
+static int
+test_mlfq_interactive(void)
+{
+	struct timeval start, now, diff;
+	long total = 0;
+	int ii;
+
+	for (ii = 0; ii < NROUNDS; ii++) {
+		spin(10);
+		gettimeofday(&start, NULL);
+		thread_yield(THREAD_ANY);
+		gettimeofday(&now, NULL);
+		timersub(&now, &start, &diff);
+		total += diff.tv_sec * 1000000 + diff.tv_usec;
+	}
+	return total / NROUNDS;
+}
+
+/* runs the interactive thread next to NHOGS hogs, and returns its latency */
+static int
+test_mlfq_latency(void)
+{
+	Tid hog[NHOGS], interactive;
+	int latency;
+	int ii;
+
+	stop = 0;
+	for (ii = 0; ii < NHOGS; ii++) {
+		hog[ii] = thread_create((thread_entry_f)test_mlfq_hog,
+		                        (void *)(long)ii);
+		assert(thread_ret_ok(hog[ii]));
+	}
+	/* let the hogs use up their allotments */
+	spin(10 * SIG_INTERVAL);
+
+	interactive = thread_create((thread_entry_f)test_mlfq_interactive,
+	                            NULL);
+	assert(thread_ret_ok(interactive));
+	assert(thread_wait(interactive, &latency) == interactive);
+	stop = 1;
+	for (ii = 0; ii < NHOGS; ii++) {
+		assert(thread_wait(hog[ii], NULL) == hog[ii]);
+	}
+	return latency;
+}
+
+int
+main()
+{
+	int latency, fcfs_latency;
+
+	printf("starting mlfq test\n");
+
+	struct config config = {
+		.sched_name = "mlfq", .preemptive = true, .verbose = false
+	};
+	ut369_start(&config);
+
+	latency = test_mlfq_latency();
+	assert(scheduler_switch("fcfs") == 0);
+	fcfs_latency = test_mlfq_latency();
+
+	/* round-robin makes it wait for every hog to use a quantum; as it never
+	 * uses one up, it should only wait for the hog that it yielded to,
+	 * apart from right after a boost. Both are measured on the same host,
+	 * so another process competing for the CPU slows down both. */
+	printf("interactive latency: %s\n",
+	       latency < fcfs_latency / 2 ? "ok" : "bad");
+	assert(latency < fcfs_latency / 2);
+
+	printf("mlfq test done\n");
+	return 0;
+}
@@ -0,0 +1,73 @@
+#include "test.h"
+#include <string.h>
+#include <libgen.h>
+#include <limits.h>
+
+#define NTHREADS 8
+
+static int order[NTHREADS];
+static int nr_run;
+
+static int
+test_plugin_thread(int num)
+{
+	order[nr_run++] = num;
+	return num;
+}
+
+/* create the children and let them all run, returning how many ran in
+ * the reverse order of their creation */
+static int
+test_plugin_run(void)
+{
+	Tid child[NTHREADS];
+	int ii, nr_reversed = 0;
+
+	nr_run = 0;
+	for (ii = 0; ii < NTHREADS; ii++) {
+		child[ii] = thread_create((thread_entry_f)test_plugin_thread,
+		                          (void *)(long)ii);
+		assert(thread_ret_ok(child[ii]));
+	}
+	while (thread_yield(THREAD_ANY) != THREAD_NONE);
+	assert(nr_run == NTHREADS);
+	for (ii = 0; ii < NTHREADS; ii++) {
+		assert(thread_wait(child[ii], NULL) == child[ii]);
+		nr_reversed += order[ii] == NTHREADS - 1 - ii;
+	}
+	return nr_reversed;
+}
+
+int
+main(int argc, const char * argv[])
+{
+	char dir[PATH_MAX], path[PATH_MAX];
+
+	(void)argc;
+	printf("starting plugin test\n");
+
+	/* the plugin is built next to this program */
+	strncpy(dir, argv[0], sizeof(dir) - 1);
+	dir[sizeof(dir) - 1] = '\0';
+	snprintf(path, sizeof(path), "%s/plugins/lifo.so", dirname(dir));
+
+	struct config config = {
+		.sched_name = path, .preemptive = false, .verbose = false
+	};
+	ut369_start(&config);
+
+	/* the main thread yields first, so the children run newest first */
+	assert(test_plugin_run() == NTHREADS);
+	printf("plugin scheduler: ok\n");
+
+	assert(scheduler_switch("./no/such/plugin.so") == THREAD_INVALID);
+	assert(scheduler_switch(path) == 0);
+	assert(scheduler_switch("fcfs") == 0);
+	assert(test_plugin_run() == 0);
+	assert(scheduler_switch(path) == 0);
+	assert(test_plugin_run() == NTHREADS);
+	printf("switch to and from plugin: ok\n");
+
+	printf("plugin test done\n");
+	return 0;
+}
@@ -0,0 +1,122 @@
+/*
+ * hooks.c
+ *
+ * A first-come first-served scheduler, built as a plugin that records the
+ * calls to its on_yield, on_wake and on_exit hooks. It has no on_block hook,
+ * so the runtime must time the sleep of a blocked thread without one.
+ */
+
+#include "../../ut369.h"
+#include "../../thread.h"
+#include "../../schedule.h"
+#include "hooks.h"
+#include <stdlib.h>
+
+struct hooks_log hooks_log;
+
+static struct thread *head = NULL;
+static struct thread *tail = NULL;
+
+static int
+hooks_init(void)
+{
+    head = NULL;
+    tail = NULL;
+    return 0;
+}
+
+static int
+hooks_enqueue(struct thread * thread)
+{
+    thread->next = NULL;
+    if (tail != NULL) {
+        tail->next = thread;
+    } else {
+        head = thread;
+    }
+    tail = thread;
+    return 0;
+}
+
+static struct thread *
+hooks_dequeue(void)
+{
+    struct thread * ret = head;
+
+    if (ret != NULL) {
+        head = ret->next;
+        if (head == NULL) {
+            tail = NULL;
+        }
+        ret->next = NULL;
+    }
+    return ret;
+}
+
+static struct thread *
+hooks_remove(Tid tid)
+{
+    struct thread * prev = NULL;
+
+    for (struct thread * ret = head; ret != NULL; ret = ret->next) {
+        if (ret->id == tid) {
+            if (prev != NULL) {
+                prev->next = ret->next;
+            } else {
+                head = ret->next;
+            }
+            if (tail == ret) {
+                tail = prev;
+            }
+            ret->next = NULL;
+            return ret;
+        }
+        prev = ret;
+    }
+    return NULL;
+}
+
+static void
+hooks_destroy(void)
+{
+    head = NULL;
+    tail = NULL;
+}
+
+static void
+hooks_record(struct hook_call * call, struct thread * thread, uint64_t ns)
+{
+    call->count++;
+    call->tid = thread->id;
+    call->ns = ns;
+}
+
+static void
+hooks_on_yield(struct thread * thread, uint64_t ran)
+{
+    hooks_record(&hooks_log.yield, thread, ran);
+}
+
+static void
+hooks_on_wake(struct thread * thread, uint64_t slept)
+{
+    hooks_record(&hooks_log.wake, thread, slept);
+}
+
+static void
+hooks_on_exit(struct thread * thread, uint64_t ran)
+{
+    hooks_record(&hooks_log.exit, thread, ran);
+}
+
+struct scheduler ut369_scheduler = {
+    .name = "hooks",
+    .init = hooks_init,
+    .enqueue = hooks_enqueue,
+    .dequeue = hooks_dequeue,
+    .remove = hooks_remove,
+    .destroy = hooks_destroy,
+    .on_yield = hooks_on_yield,
+    .on_wake = hooks_on_wake,
+    .on_exit = hooks_on_exit,
+};
@@ -0,0 +1,28 @@
+/*
+ * hooks.h
+ *
+ * What the hooks plugin records, for test/hooks to check.
+ */
+
+#ifndef _HOOKS_H_
+#define _HOOKS_H_
+
+#include <stdint.h>
+
+#define HOOKS_LOG_SYMBOL "hooks_log"
+
+/* one entry per hook: how often it ran, and for which thread and with
+ * which duration it ran last */
+struct hook_call {
+    int count;
+    Tid tid;
+    uint64_t ns;
+};
+
+struct hooks_log {
+    struct hook_call yield;
+    struct hook_call wake;
+    struct hook_call exit;
+};
+
+#endif /* _HOOKS_H_ */
@@ -0,0 +1,72 @@
+/*
+ * lifo.c
+ *
+ * A last-in first-out scheduler, built as a plugin to test the loading of
+ * schedulers from shared objects. The ready threads form a stack linked
+ * through their next field.
+ */
+
+#include "../../ut369.h"
+#include "../../thread.h"
+#include "../../schedule.h"
+#include <stdlib.h>
+
+static struct thread *top = NULL;
+
+static int
+lifo_init(void)
+{
+    top = NULL;
+    return 0;
+}
+
+static int
+lifo_enqueue(struct thread * thread)
+{
+    thread->next = top;
+    top = thread;
+    return 0;
+}
+
+static struct thread *
+lifo_dequeue(void)
+{
+    struct thread * ret = top;
+
+    if (ret != NULL) {
+        top = ret->next;
+        ret->next = NULL;
+    }
+    return ret;
+}
+
+static struct thread *
+lifo_remove(Tid tid)
+{
+    struct thread ** link;
+
+    for (link = &top; *link != NULL; link = &(*link)->next) {
+        struct thread * ret = *link;
+        if (ret->id == tid) {
+            *link = ret->next;
+            ret->next = NULL;
+            return ret;
+        }
+    }
+    return NULL;
+}
+
+static void
+lifo_destroy(void)
+{
+    top = NULL;
+}
+
+struct scheduler ut369_scheduler = {
+    .name = "lifo",
+    .init = lifo_init,
+    .enqueue = lifo_enqueue,
+    .dequeue = lifo_dequeue,
+    .remove = lifo_remove,
+    .destroy = lifo_destroy,
+};
@@ -0,0 +1,114 @@
+#include "test.h"
+
+#define NTHREADS 8
+#define NWAKEUPS 1000
+
+static const int prio[NTHREADS] = { 20, 3, 20, 0, 31, 3, 7, 16 };
+static int order[NTHREADS];
+static int nr_run;
+
+static fifo_queue_t *queue;
+static volatile int nr_woken;
+static volatile int stop;
+
+static int
+test_prio_thread(int num)
+{
+	order[nr_run++] = num;
+	return num;
+}
+
+/* sleeps until woken, at a more urgent priority than the main thread */
+static int
+test_prio_worker(void)
+{
+	while (1) {
+		int enabled = interrupt_off();
+		int ret = thread_sleep(queue);
+		assert(thread_ret_ok(ret));
+		interrupt_set(enabled);
+		if (stop) {
+			return 0;
+		}
+		nr_woken++;
+	}
+}
+
+int
+main()
+{
+	Tid child[NTHREADS], worker;
+	int ii, jj, enabled;
+
+	printf("starting prio test\n");
+
+	struct config config = {
+		.sched_name = "prio", .preemptive = true, .verbose = false
+	};
+	ut369_start(&config);
+
+	assert(thread_getprio(thread_id()) == THREAD_PRIO_DEFAULT);
+	assert(thread_setprio(thread_id(), THREAD_PRIO_LEVELS) == THREAD_INVALID);
+	assert(thread_setprio(thread_id(), -1) == THREAD_INVALID);
+	assert(thread_setprio(THREAD_MAX_THREADS + 1000, 0) == THREAD_INVALID);
+	assert(thread_getprio(-42) == THREAD_INVALID);
+
+	/* run last, behind every child */
+	assert(thread_setprio(thread_id(), THREAD_PRIO_LEVELS - 1) == 0);
+
+	/* priorities are changed while the children are in the ready queue */
+	enabled = interrupt_off();
+	for (ii = 0; ii < NTHREADS; ii++) {
+		child[ii] = thread_create((thread_entry_f)test_prio_thread,
+		                          (void *)(long)ii);
+		assert(thread_ret_ok(child[ii]));
+		assert(thread_getprio(child[ii]) == THREAD_PRIO_DEFAULT);
+	}
+	for (ii = 0; ii < NTHREADS; ii++) {
+		assert(thread_setprio(child[ii], prio[ii]) == 0);
+		assert(thread_getprio(child[ii]) == prio[ii]);
+	}
+	interrupt_set(enabled);
+
+	while (thread_yield(THREAD_ANY) != THREAD_NONE);
+	assert(nr_run == NTHREADS);
+
+	/* most urgent first, first-come first-served within a level */
+	for (ii = 1; ii < NTHREADS; ii++) {
+		printf("thread %d ran with priority %d\n", order[ii - 1],
+		       prio[order[ii - 1]]);
+		assert(prio[order[ii - 1]] <= prio[order[ii]]);
+		if (prio[order[ii - 1]] == prio[order[ii]]) {
+			assert(order[ii - 1] < order[ii]);
+		}
+	}
+	for (jj = 0; jj < NTHREADS; jj++) {
+		assert(thread_wait(child[jj], NULL) == child[jj]);
+	}
+
+	/* waking up a more urgent thread hands it the CPU right away */
+	queue = queue_create(THREAD_MAX_THREADS);
+	assert(queue != NULL);
+	worker = thread_create((thread_entry_f)test_prio_worker, NULL);
+	assert(thread_ret_ok(worker));
+	assert(thread_setprio(worker, 0) == 0);
+	thread_yield(worker);
+	for (ii = 0; ii < NWAKEUPS; ii++) {
+		spin(20);
+		enabled = interrupt_off();
+		assert(thread_wakeup(queue, 0) == 1);
+		interrupt_set(enabled);
+		assert(nr_woken == ii + 1);
+	}
+	printf("wakeup preemption: ok\n");
+
+	stop = 1;
+	interrupt_off();
+	assert(thread_wakeup(queue, 0) == 1);
+	interrupt_on();
+	assert(thread_wait(worker, NULL) == worker);
+	queue_destroy(queue);
+
+	printf("prio test done\n");
+	return 0;
+}
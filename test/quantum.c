@@ -0,0 +1,107 @@
+#include "test.h"
+#include <string.h>
+#include <time.h>
+
+#define QUANTUM 5000
+#define NR_HOGS 2
+#define HOG_USECS 300000
+
+static long slices[NR_HOGS];
+static long sliced_usecs[NR_HOGS];
+static volatile long turn = -1;     /* the hog that ran last */
+static clockid_t slice_clock = CLOCK_MONOTONIC;
+
+/* the time on the clock that the quantum is measured on. CPU time is that
+ * of the kernel thread, which both hogs share. */
+static long
+now_usecs(void)
+{
+	struct timespec now;
+
+	clock_gettime(slice_clock, &now);
+	return now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/* spins for HOG_USECS, and measures how long it runs between the turns of
+ * the other hog. A gap in which the kernel runs another process does not
+ * end a slice. */
+static int
+test_hog(long id)
+{
+	long start = now_usecs();
+	long slice_start = start, last = start;
+
+	turn = id;
+	while (last - start < HOG_USECS) {
+		long now = now_usecs();
+		if (turn != id) {
+			turn = id;
+			slices[id]++;
+			sliced_usecs[id] += last - slice_start;
+			/* the other hog may have run since now was read */
+			now = now_usecs();
+			slice_start = now;
+		}
+		last = now;
+	}
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	Tid tids[NR_HOGS];
+	long nr = 0, usecs = 0;
+	bool ok;
+	const char *clock = argc > 1 ? argv[1] : "real";
+
+	printf("starting quantum test (%s)\n", clock);
+
+	struct config config = {
+		.sched_name = "fcfs", .preemptive = true, .verbose = false,
+		.quantum = QUANTUM
+	};
+	if (strcmp(clock, "cpu") == 0) {
+		config.clock = PREEMPT_CLOCK_CPU;
+		slice_clock = CLOCK_THREAD_CPUTIME_ID;
+	} else if (strcmp(clock, "instructions") == 0) {
+		config.clock = PREEMPT_CLOCK_INSTRUCTIONS;
+	} else if (strcmp(clock, "real") != 0) {
+		fprintf(stderr, "usage: %s [real|cpu|instructions]\n", argv[0]);
+		exit(1);
+	}
+	ut369_start(&config);
+
+	for (long i = 0; i < NR_HOGS; i++) {
+		tids[i] = thread_create((thread_entry_f)test_hog, (void *)i);
+		assert(thread_ret_ok(tids[i]));
+	}
+	for (int i = 0; i < NR_HOGS; i++) {
+		assert(thread_wait(tids[i], NULL) == tids[i]);
+		nr += slices[i];
+		usecs += sliced_usecs[i];
+	}
+
+	/* the hogs take turns, each running for about a quantum, not for the
+	 * default SIG_INTERVAL. How long a quantum of instructions takes
+	 * depends on the CPU. When another process competes for the CPU, the
+	 * time it gets at the end of a real-time slice is nobody's slice, and
+	 * the kernel checks a CPU-time timer only on the ticks that find the
+	 * thread running, so such a slice can last many ticks longer, or the
+	 * whole run. */
+	assert(nr > 0 || config.clock == PREEMPT_CLOCK_CPU);
+	if (config.clock == PREEMPT_CLOCK_INSTRUCTIONS) {
+		unintr_printf("hogs took turns\n");
+		printf("quantum test done\n");
+		return 0;
+	}
+	ok = nr == 0 ||
+	     (usecs / nr > QUANTUM / 4 &&
+	      (config.clock == PREEMPT_CLOCK_CPU || usecs / nr < QUANTUM * 3));
+	unintr_printf("%ld slices, %s\n", nr,
+	              ok ? "about a quantum each" : "of the wrong length");
+	assert(ok);
+
+	printf("quantum test done\n");
+	return 0;
+}
@@ -0,0 +1,73 @@
+#include "test.h"
+
+/* well below the ~32000 live threads that vm.max_map_count allows, see
+ * max_threads in struct config */
+#define NTHREADS 2000
+
+static fifo_queue_t *queue;
+static int order[NTHREADS];
+static int nr_woken;
+
+/* sleep on the shared queue, then record the wakeup order */
+static int
+test_queue_sleeper(int num)
+{
+	int enabled = interrupt_off();
+	int ret = thread_sleep(queue);
+	assert(thread_ret_ok(ret));
+	interrupt_set(enabled);
+	order[nr_woken++] = num;
+	return num;
+}
+
+int
+main()
+{
+	Tid child[NTHREADS];
+	int exit_code;
+	int ii;
+
+	printf("starting queue test\n");
+
+	struct config config = {
+		.sched_name = "fcfs", .preemptive = false, .verbose = false,
+		.max_threads = NTHREADS + 1
+	};
+	ut369_start(&config);
+
+	queue = queue_create(NTHREADS);
+	assert(queue != NULL);
+	for (ii = 0; ii < NTHREADS; ii++) {
+		child[ii] = thread_create((thread_entry_f)test_queue_sleeper,
+		                          (void *)(long)ii);
+		assert(thread_ret_ok(child[ii]));
+	}
+	while (thread_yield(THREAD_ANY) != THREAD_NONE);
+	assert(queue_count(queue) == NTHREADS);
+
+	/* killing a waiter takes it out of the middle of the queue, and a
+	 * directed yield takes it out of the middle of the ready queue */
+	for (ii = 1; ii < NTHREADS; ii += 2) {
+		assert(thread_kill(child[ii]) == child[ii]);
+	}
+	assert(queue_count(queue) == NTHREADS / 2);
+	assert(thread_yield(child[NTHREADS / 2 + 1]) == child[NTHREADS / 2 + 1]);
+
+	/* the remaining waiters still wake up in the order they went to
+	 * sleep */
+	interrupt_off();
+	assert(thread_wakeup(queue, 1) == NTHREADS / 2);
+	interrupt_on();
+	for (ii = 0; ii < NTHREADS; ii++) {
+		assert(thread_wait(child[ii], &exit_code) == child[ii]);
+		assert(exit_code == (ii % 2 ? THREAD_KILLED : ii));
+	}
+	assert(nr_woken == NTHREADS / 2);
+	for (ii = 0; ii < nr_woken; ii++) {
+		assert(order[ii] == 2 * ii);
+	}
+	queue_destroy(queue);
+
+	printf("queue test done\n");
+	return 0;
+}
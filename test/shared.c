@@ -0,0 +1,84 @@
+#include "test.h"
+
+#define NTHREADS 256
+#define DEPTH     16
+#define DEEP     800  /* enough frames for a save buffer of its own mapping */
+
+/* recurse with some live locals on the stack, yielding at every level so
+ * that the frames are saved and restored many times over */
+static long
+test_shared_recurse(int num, int depth)
+{
+	volatile long local[8];
+	long sum = 0;
+	int ii;
+
+	for (ii = 0; ii < 8; ii++) {
+		local[ii] = (long)num * 1000 + depth * 10 + ii;
+	}
+	thread_yield(THREAD_ANY);
+	if (depth > 0) {
+		sum = test_shared_recurse(num, depth - 1);
+	}
+	thread_yield(THREAD_ANY);
+	for (ii = 0; ii < 8; ii++) {
+		assert(local[ii] == (long)num * 1000 + depth * 10 + ii);
+		sum += local[ii];
+	}
+	return sum;
+}
+
+static long
+test_shared_expected(int num, int max_depth)
+{
+	long sum = 0;
+	for (int depth = 0; depth <= max_depth; depth++) {
+		for (int ii = 0; ii < 8; ii++) {
+			sum += (long)num * 1000 + depth * 10 + ii;
+		}
+	}
+	return sum;
+}
+
+/* a few threads go deep, so that their saved frames grow from a small
+ * buffer to a large one and back */
+static int
+test_shared_thread(int num)
+{
+	int depth = num % 64 == 1 ? DEEP : DEPTH;
+	long sum = test_shared_recurse(num, depth);
+	assert(sum == test_shared_expected(num, depth));
+	return num;
+}
+
+int
+main()
+{
+	Tid child[NTHREADS];
+	int ii, exitcode;
+	Tid ret;
+
+	printf("starting shared test\n");
+
+	struct config config = {
+		.sched_name = "rand", .preemptive = true, .verbose = false
+	};
+	ut369_start(&config);
+
+	/* mix shared-stack threads with threads on private stacks */
+	for (ii = 0; ii < NTHREADS; ii++) {
+		struct thread_attr attr = { .shared_stack = (ii % 4 != 0) };
+		child[ii] = thread_create_attr((thread_entry_f)test_shared_thread,
+		                               (void *)(long)ii, &attr);
+		assert(thread_ret_ok(child[ii]));
+	}
+
+	for (ii = 0; ii < NTHREADS; ii++) {
+		ret = thread_wait(child[ii], &exitcode);
+		assert(ret == child[ii]);
+		assert(exitcode == ii);
+	}
+
+	printf("shared test done\n");
+	return 0;
+}
@@ -0,0 +1,84 @@
+#include "test.h"
+#include <string.h>
+
+#define DURATION 1000000 /* usecs */
+#define NTHREADS 3
+
+/* a 70/20/10 split of the CPU */
+static const int tickets[NTHREADS] = { 700, 200, 100 };
+static volatile int stop;
+static volatile long work[NTHREADS];
+
+/* burn CPU, counting the work done */
+static int
+test_stride_hog(int num)
+{
+	while (!stop) {
+		work[num]++;
+	}
+	return num;
+}
+
+int
+main(int argc, const char * argv[])
+{
+	Tid child[NTHREADS];
+	const char *name = "stride";
+	long total = 0;
+	int ii;
+
+	if (argc > 2 || (argc == 2 && strcmp(argv[1], "stride") != 0 &&
+	                 strcmp(argv[1], "lottery") != 0)) {
+		fprintf(stderr, "usage: %s [stride|lottery]\n", argv[0]);
+		exit(1);
+	}
+	if (argc == 2) {
+		name = argv[1];
+	}
+
+	printf("starting %s test\n", name);
+
+	struct config config = {
+		.sched_name = name, .preemptive = true, .verbose = false
+	};
+	ut369_start(&config);
+
+	assert(thread_get_tickets(thread_id()) == THREAD_TICKETS_DEFAULT);
+	assert(thread_set_tickets(thread_id(), 0) == THREAD_INVALID);
+	assert(thread_set_tickets(thread_id(), THREAD_TICKETS_MAX + 1) ==
+	       THREAD_INVALID);
+	assert(thread_set_tickets(THREAD_MAX_THREADS + 1000, 1) ==
+	       THREAD_INVALID);
+	assert(thread_get_tickets(-42) == THREAD_INVALID);
+
+	/* the main thread gets a single ticket, so it barely competes */
+	assert(thread_set_tickets(thread_id(), 1) == 0);
+	for (ii = 0; ii < NTHREADS; ii++) {
+		child[ii] = thread_create((thread_entry_f)test_stride_hog,
+		                          (void *)(long)ii);
+		assert(thread_ret_ok(child[ii]));
+		assert(thread_set_tickets(child[ii], tickets[ii]) == 0);
+		assert(thread_get_tickets(child[ii]) == tickets[ii]);
+	}
+	spin(DURATION);
+	stop = 1;
+
+	for (ii = 0; ii < NTHREADS; ii++) {
+		assert(thread_wait(child[ii], NULL) == child[ii]);
+		total += work[ii];
+	}
+
+	/* each quantum is 200 usecs, so there are thousands of draws and even
+	 * the lottery should be within a few percent */
+	for (ii = 0; ii < NTHREADS; ii++) {
+		double share = (double)work[ii] / total;
+		double expect = tickets[ii] / 1000.0;
+		printf("thread %d share: %s\n", ii,
+		       share > expect - 0.03 && share < expect + 0.03 ?
+		       "ok" : "bad");
+		assert(share > expect - 0.03 && share < expect + 0.03);
+	}
+
+	printf("%s test done\n", name);
+	return 0;
+}
@@ -0,0 +1,60 @@
+#include "test.h"
+#include "../carrier.h"
+
+#define HOG_USECS 100000
+
+static volatile int hog_ran;
+
+/* return whether the preemption timer is armed */
+static int
+ticking(void)
+{
+	struct itimerspec spec;
+
+	assert(timer_gettime(carrier_self()->timer, &spec) == 0);
+	return spec.it_value.tv_sec != 0 || spec.it_value.tv_nsec != 0;
+}
+
+/* only gets to run if the main thread is preempted */
+static int
+test_tickless_hog(void)
+{
+	hog_ran = 1;
+	spin(HOG_USECS);
+	return 0;
+}
+
+int
+main()
+{
+	Tid hog;
+
+	printf("starting tickless test\n");
+
+	struct config config = {
+		.sched_name = "fcfs", .preemptive = true, .verbose = false
+	};
+	ut369_start(&config);
+
+	/* alone, the main thread has nobody to be preempted for */
+	spin(HOG_USECS);
+	assert(!ticking());
+	printf("tick stops while no thread is ready\n");
+
+	/* a ready thread restarts it, and then gets the CPU */
+	hog = thread_create((thread_entry_f)test_tickless_hog, NULL);
+	assert(thread_ret_ok(hog));
+	assert(ticking());
+	while (!hog_ran) {
+		spin(1000);
+	}
+	printf("tick restarts when a thread is ready\n");
+
+	assert(thread_wait(hog, NULL) == hog);
+	spin(HOG_USECS);
+	assert(!ticking());
+	printf("tick stops again\n");
+
+	printf("tickless test done\n");
+	return 0;
+}
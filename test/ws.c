@@ -0,0 +1,179 @@
+#include "test.h"
+#include "../carrier.h"
+
+#define NR_CARRIERS 4
+#define NR_YIELDERS 3
+#define NR_YIELDS 100
+#define NR_WORKERS 16
+#define NR_ROUNDS 1000
+#define BARRIER_USECS 10000000
+#define NR_STRANDED 2  /* fewer than WS_REMOTE_STEAL */
+
+static int nr_started;
+static int arrived;
+static int log_len;
+static int order[NR_YIELDERS * NR_YIELDS];
+static struct lock *lock;
+static long counter;
+static volatile int phase;
+static Tid stranded[NR_STRANDED];
+
+static int
+test_yielder(long id)
+{
+	for (int i = 0; i < NR_YIELDS; i++) {
+		int enabled = interrupt_off();
+		order[log_len++] = (int)id;
+		interrupt_set(enabled);
+		thread_yield(THREAD_ANY);
+	}
+	return 0;
+}
+
+/* spins without yielding until a thread runs on each carrier. They are all
+ * made ready by the main thread, so the other carriers must steal them. */
+static int
+test_barrier(void)
+{
+	struct timeval start, now, diff;
+
+	__atomic_add_fetch(&arrived, 1, __ATOMIC_SEQ_CST);
+	gettimeofday(&start, NULL);
+	while (__atomic_load_n(&arrived, __ATOMIC_SEQ_CST) < nr_started) {
+		gettimeofday(&now, NULL);
+		timersub(&now, &start, &diff);
+		if (diff.tv_sec * 1000000 + diff.tv_usec > BARRIER_USECS) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int
+test_counter(void)
+{
+	for (int i = 0; i < NR_ROUNDS; i++) {
+		assert(lock_acquire(lock) == 0);
+		long value = counter;
+		if (i % 5 == 0) {
+			thread_yield(THREAD_ANY);
+		}
+		counter = value + 1;
+		lock_release(lock);
+	}
+	return 0;
+}
+
+static int
+test_stranded(void)
+{
+	return 0;
+}
+
+/* runs on a carrier of its own, where it makes a few threads ready that
+ * no other carrier may steal once every carrier is on its own node */
+static int
+test_remote(void)
+{
+	phase = 1;
+	while (phase != 2);
+	for (int i = 0; i < NR_STRANDED; i++) {
+		stranded[i] = thread_create((thread_entry_f)test_stranded, NULL);
+		assert(thread_ret_ok(stranded[i]));
+	}
+	phase = 3;
+	while (phase != 4);
+	return 0;
+}
+
+int
+main(int argc, const char * argv[])
+{
+	Tid tids[NR_WORKERS];
+	int exit_code;
+
+	nr_started = argc > 1 ? atoi(argv[1]) : NR_CARRIERS;
+	if (nr_started < 1 || nr_started > NR_WORKERS) {
+		fprintf(stderr, "usage: %s [carriers]\n", argv[0]);
+		exit(1);
+	}
+	printf("starting ws test (%d carriers)\n", nr_started);
+
+	struct config config = {
+		.sched_name = "ws", .preemptive = false, .verbose = false,
+		.carriers = nr_started
+	};
+	ut369_start(&config);
+
+	/* the yielders take turns, whichever carriers they land on */
+	for (long i = 0; i < NR_YIELDERS; i++) {
+		tids[i] = thread_create((thread_entry_f)test_yielder, (void *)i);
+		assert(thread_ret_ok(tids[i]));
+	}
+	for (int i = 0; i < NR_YIELDERS; i++) {
+		assert(thread_wait(tids[i], NULL) == tids[i]);
+	}
+	assert(log_len == NR_YIELDERS * NR_YIELDS);
+	if (nr_started == 1) {
+		for (int i = 0; i < log_len; i++) {
+			assert(order[i] == i % NR_YIELDERS);
+		}
+		unintr_printf("yielders ran in turn\n");
+	}
+
+	for (int i = 0; i < nr_started - 1; i++) {
+		tids[i] = thread_create((thread_entry_f)test_barrier, NULL);
+		assert(thread_ret_ok(tids[i]));
+	}
+	assert(test_barrier() == 0);
+	for (int i = 0; i < nr_started - 1; i++) {
+		assert(thread_wait(tids[i], &exit_code) == tids[i]);
+		assert(exit_code == 0);
+	}
+	unintr_printf("threads were spread over %d carriers\n", nr_started);
+
+	lock = lock_create();
+	assert(lock != NULL);
+	for (int i = 0; i < NR_WORKERS; i++) {
+		tids[i] = thread_create((thread_entry_f)test_counter, NULL);
+		assert(thread_ret_ok(tids[i]));
+	}
+	for (int i = 0; i < NR_WORKERS; i++) {
+		assert(thread_wait(tids[i], NULL) == tids[i]);
+	}
+	assert(counter == NR_WORKERS * NR_ROUNDS);
+	lock_destroy(lock);
+	unintr_printf("counter is %ld\n", counter);
+
+	/* switching away from ws takes the threads of remote carriers too,
+	 * however few they are */
+	if (nr_started > 1) {
+		Tid remote = thread_create((thread_entry_f)test_remote, NULL);
+		int enabled;
+
+		assert(thread_ret_ok(remote));
+		while (phase != 1);
+		enabled = interrupt_off();
+		for (int i = 0; i < nr_started; i++) {
+			carrier_get(i)->node = i;
+		}
+		interrupt_set(enabled);
+		phase = 2;
+		while (phase != 3);
+		assert(scheduler_switch("fcfs") == 0);
+		phase = 4;
+		enabled = interrupt_off();
+		for (int i = 0; i < nr_started; i++) {
+			carrier_get(i)->node = -1;
+		}
+		interrupt_set(enabled);
+		assert(thread_wait(remote, NULL) == remote);
+		for (int i = 0; i < NR_STRANDED; i++) {
+			assert(thread_wait(stranded[i], NULL) == stranded[i]);
+		}
+		unintr_printf("switched away with threads on remote carriers\n");
+	}
+
+	printf("ws test done\n");
+	return 0;
+}
@@ -0,0 +1,75 @@
+#include "test.h"
+
+#define NTHREADS 200
+#define CACHE_HIGH 8
+
+static int
+test_zombie_thread(int num)
+{
+	return num;
+}
+
+/* number of memory mappings of the process */
+static int
+count_mappings(void)
+{
+	FILE *maps = fopen("/proc/self/maps", "r");
+	int count = 0;
+	int c;
+
+	assert(maps != NULL);
+	while ((c = fgetc(maps)) != EOF) {
+		count += c == '\n';
+	}
+	fclose(maps);
+	return count;
+}
+
+int
+main()
+{
+	Tid tids[NTHREADS];
+	int before, after, exitcode;
+
+	printf("starting zombie test\n");
+
+	struct config config = {
+		.sched_name = "fcfs", .preemptive = false, .verbose = false,
+		.cache_high = CACHE_HIGH, .cache_low = CACHE_HIGH / 2
+	};
+	ut369_start(&config);
+
+	/* warm up the stack cache so that the count below is stable */
+	for (int i = 0; i < CACHE_HIGH; i++) {
+		tids[i] = thread_create((thread_entry_f)test_zombie_thread,
+		                        (void *)(long)i);
+		assert(thread_ret_ok(tids[i]));
+	}
+	for (int i = 0; i < CACHE_HIGH; i++) {
+		assert(thread_wait(tids[i], NULL) == tids[i]);
+	}
+
+	/* threads that exit without being waited for are zombies, but their
+	 * stacks are released already, so they do not pile up */
+	before = count_mappings();
+	for (int i = 0; i < NTHREADS; i++) {
+		tids[i] = thread_create((thread_entry_f)test_zombie_thread,
+		                        (void *)(long)i);
+		assert(thread_ret_ok(tids[i]));
+		assert(thread_yield(tids[i]) == tids[i]);
+	}
+	after = count_mappings();
+	printf("%d mappings before, %d after %d zombies\n", before, after,
+	       NTHREADS);
+	assert(after - before <= 2 * CACHE_HIGH);
+
+	/* the zombies can still be reaped */
+	for (int i = 0; i < NTHREADS; i++) {
+		assert(thread_wait(tids[i], &exitcode) == tids[i]);
+		assert(exitcode == i);
+	}
+
+	printf("zombie test done\n");
+	thread_exit(0);
+	return 0;
+}
@@ -7,18 +7,87 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
 #include "ut369.h"
 #include "queue.h"
 #include "thread.h"
 #include "schedule.h"
 #include "interrupt.h"
+#include "context.h"
+#include "stack.h"
+#include "carrier.h"
 
 /* TODO: put your global variables here */
 
-static struct thread *current_thread;
-static struct thread *previous_thread;
-static struct thread *all_threads[THREAD_MAX_THREADS];
-static int available_ids[THREAD_MAX_THREADS];
+/* each carrier runs a thread of its own, see carrier.h */
+#define current_thread (carrier_self()->current)
+
+/* Number of carriers running a user thread rather than their idle loop. A
+ * thread may only leave its carrier idle when another one is busy, since
+ * otherwise nothing could ever make a thread ready again. */
+static int busy_carriers;
+
+/* Thread table indexed by Tid. It starts small and doubles on demand up to
+ * max_threads entries. Tids below next_tid have been handed out before;
+ * those not in use are kept on the free_tids stack so that allocating a Tid
+ * is O(1). generations[tid] is bumped each time tid is freed, which is what
+ * makes thread handles of reaped threads stale. */
+static struct thread **all_threads;
+static uint32_t *generations;
+static Tid *free_tids;
+static int nr_free_tids;
+static int table_size;
+static Tid next_tid;
+static int max_threads;
+
+/* Free list of reaped threads whose struct and wait queue are kept for the
+ * next thread_create. Linked through the (unused) next field. Once it would
+ * grow past cache_high, it is trimmed back down to cache_low. */
+static struct thread *thread_cache;
+static int cache_count;
+static int cache_high;
+static int cache_low;
+
+/* Free list of the stacks of exited threads, bounded like thread_cache. A
+ * stack is released as soon as its thread has switched away for the last
+ * time, since a zombie may never be reaped. Each one is linked through a
+ * header at its top, the part of it that is already paged in. */
+struct cached_stack {
+	struct cached_stack *next;
+	void *stack;
+	size_t size;
+	int node;
+};
+static struct cached_stack *stack_cache;
+static int stack_cache_count;
+
+/* alternate signal stack, so that a stack overflow can still be reported */
+static stack_t segv_stack;
+
+/* Stack shared by threads created with the shared_stack attribute, mapped on
+ * first use. shared_owner is the thread whose frames are currently on it; the
+ * frames of every other shared-stack thread live in its saved_stack buffer.
+ * The frames are swapped by thread_switcher, which runs on a stack of its own
+ * because they cannot be copied while running on the shared stack. */
+static void *shared_stack;
+static size_t shared_size;
+static struct thread *shared_owner;
+static void *switcher_stack;
+static void *switcher_sp;
+
+/* state of the xorshift64* generator behind thread_random */
+static uint64_t random_state;
+
+/* number of deadlines that were missed, see thread_check_deadline */
+static unsigned long deadline_misses;
+
+/* Number of threads in the scheduler's ready queue. While it is 0, nothing
+ * is waiting for the CPU and the preemption tick can stop. */
+static int nr_ready;
+
+static void thread_wake(struct thread *woken_thread);
 
 /**************************************************************************
  * Cooperative threads: Refer to ut369.h and this file for the detailed 
@@ -31,40 +100,181 @@ void signal_handler(int signum) {
     }
 }
 
+/* Report the thread that ran into the guard page below its stack and crash.
+ * Runs on segv_stack since the faulting stack has no room left. Any other
+ * fault is left to the default action.
+ */
+static void
+thread_segv_handler(int sig, siginfo_t * sip, void *contextVP)
+{
+	struct thread *t = current_thread;
+	(void)contextVP;
+
+	if (shared_stack != NULL && stack_in_guard(shared_stack, sip->si_addr)) {
+		// only the running thread can be on the shared stack
+	} else if (t == NULL || t->stack_pointer == NULL ||
+	    !stack_in_guard(t->stack_pointer, sip->si_addr)) {
+		t = NULL;
+		for (int i = 0; i < next_tid && t == NULL; i++) {
+			if (all_threads[i] != NULL &&
+			    all_threads[i]->stack_pointer != NULL &&
+			    stack_in_guard(all_threads[i]->stack_pointer, sip->si_addr)) {
+				t = all_threads[i];
+			}
+		}
+	}
+
+	signal(sig, SIG_DFL);
+	if (t != NULL) {
+		char msg[128];
+		int len = snprintf(msg, sizeof(msg), "thread %d: stack overflow "
+		                   "(%zu byte stack, fault at %p)\n", t->id,
+		                   t->shared_stack ? shared_size : t->stack_size,
+		                   sip->si_addr);
+		(void)write(STDERR_FILENO, msg, len);
+		abort();
+	}
+}
+
+/* Entry point of the idle context of carrier 0, whose kernel thread runs
+ * the main thread on the process stack. */
+static void
+thread_idle_stub(void *unused0, void *unused1)
+{
+	(void)unused0;
+	(void)unused1;
+	thread_idle();
+}
+
+/* Give carrier c the thread that it switches to when it has nothing to run.
+ * It is not in the thread table and is never enqueued. Carrier 0 runs it on
+ * a stack of its own, the other carriers on their kernel thread's stack. */
+static void
+thread_idle_init(struct carrier *c)
+{
+	struct thread *idle = calloc(1, sizeof(struct thread));
+
+	assert(idle != NULL);
+	node_init(idle, THREAD_NONE);
+	idle->state = running;
+	idle->priority = THREAD_PRIO_LEVELS - 1;
+	idle->base_priority = THREAD_PRIO_LEVELS - 1;
+	idle->tickets = THREAD_TICKETS_DEFAULT;
+	idle->slot = -1;
+	idle->node = -1;
+	idle->self = idle;
+	if (c->index == 0) {
+		idle->stack_size = stack_round(THREAD_MIN_STACK);
+		idle->stack_pointer = stack_alloc(idle->stack_size);
+		assert(idle->stack_pointer != NULL);
+		idle->saved_sp = context_init(stack_top(idle->stack_pointer,
+		                                        idle->stack_size),
+		                              thread_idle_stub, NULL, NULL);
+	} else {
+		c->current = idle;
+	}
+	c->idle = idle;
+}
+
 /* Initialize the thread subsystem */
 void
-thread_init(void)
+thread_init(const struct config *config)
 {
+	carrier_init(config->carriers, config->cpus);
+	busy_carriers = 1;
+	if (nr_carriers > 1) {
+		for (int i = 0; i < nr_carriers; i++) {
+			thread_idle_init(carrier_get(i));
+		}
+	}
+	cache_high = config->cache_high > 0 ? config->cache_high
+	                                    : THREAD_CACHE_HIGH;
+	cache_low = config->cache_low > 0 ? config->cache_low : THREAD_CACHE_LOW;
+	shared_size = stack_round(config->shared_stack_size > 0 ?
+	                          config->shared_stack_size : THREAD_SHARED_STACK);
+	if (cache_low > cache_high) {
+		cache_low = cache_high;
+	}
+	thread_cache = NULL;
+	cache_count = 0;
+	stack_cache = NULL;
+	stack_cache_count = 0;
+	deadline_misses = 0;
+	nr_ready = 0;
+	// spread the seed over all the bits, a zero state would stay zero
+	random_state = config->seed != 0 ? config->seed : THREAD_SEED_DEFAULT;
+	random_state *= 0x9e3779b97f4a7c15ull;
+	random_state ^= random_state >> 31;
+
+	max_threads = config->max_threads > 0 ? config->max_threads
+	                                      : THREAD_MAX_THREADS;
+	table_size = max_threads < THREAD_TABLE_INIT ? max_threads
+	                                             : THREAD_TABLE_INIT;
+	all_threads = calloc(table_size, sizeof(struct thread *));
+	free_tids = malloc(table_size * sizeof(Tid));
+	generations = malloc(table_size * sizeof(uint32_t));
+	assert(all_threads != NULL && free_tids != NULL && generations != NULL);
+	for (int i = 0; i < table_size; i++) {
+		generations[i] = 1;
+	}
+	nr_free_tids = 0;
+
 	// Initialize the first thread (main thread)
 	struct thread *main_thread = malloc(sizeof(struct thread));
 	assert(main_thread != NULL);
 
-	main_thread->id = 0;
+	node_init(main_thread, 0);
 	main_thread->state = running;
 	main_thread->is_killed = false;
+	main_thread->priority = THREAD_PRIO_DEFAULT;
+	main_thread->base_priority = THREAD_PRIO_DEFAULT;
+	main_thread->held_locks = NULL;
+	main_thread->sched_node = (struct heap_node){ 0 };
+	main_thread->vruntime = 0;
+	main_thread->tickets = THREAD_TICKETS_DEFAULT;
+	main_thread->quantum = 0;
+	main_thread->level = 0;
+	main_thread->level_ticks = 0;
+	main_thread->level_epoch = 0;
+	main_thread->deadline = 0;
+	main_thread->deadline_missed = false;
+	main_thread->slot = -1;
+	main_thread->stamp = 0;
 
 
 	main_thread->self = main_thread;
-	main_thread->wait_queue = queue_create(THREAD_MAX_THREADS);
+	main_thread->wait_queue = queue_create(max_threads);
 	queue_set_owner(main_thread->wait_queue, &(main_thread->self));
 
 	main_thread->waiting_for_queue = NULL;
+	// the main thread runs on the process stack
+	main_thread->stack_pointer = NULL;
+	main_thread->stack_size = 0;
+	main_thread->node = -1;
+	main_thread->shared_stack = false;
+	main_thread->saved_stack = NULL;
+	main_thread->saved_capacity = 0;
 
 	struct sigaction sa;
     sa.sa_handler = signal_handler;
     sigemptyset(&sa.sa_mask);
     sa.sa_flags = 0;
     sigaction(SIGALRM, &sa, NULL);
+
+	segv_stack.ss_sp = malloc(SIGSTKSZ);
+	assert(segv_stack.ss_sp != NULL);
+	segv_stack.ss_size = SIGSTKSZ;
+	segv_stack.ss_flags = 0;
+	sigaltstack(&segv_stack, NULL);
+	sa.sa_sigaction = thread_segv_handler;
+	sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+	sigaction(SIGSEGV, &sa, NULL);
 	// Set the current thread to the main thread
 	current_thread = main_thread;
 
-    for (int i = 1; i < THREAD_MAX_THREADS; i++) {
-        available_ids[i] = 1;
-    }
-
-	available_ids[0] = 0;
-
+	// the main thread is always Tid 0
 	all_threads[0] = current_thread;
+	next_tid = 1;
 }
 
 /* Returns the tid of the current running thread. */
@@ -74,23 +284,238 @@ thread_id(void)
 	return current_thread->id;
 }
 
+/* Return the maximum number of threads that can exist at once. */
+int
+thread_max(void)
+{
+	return max_threads;
+}
+
+/* Return the thread structure of the running thread. */
+struct thread *
+thread_current(void)
+{
+	return current_thread;
+}
+
+/* Return the next number from the runtime's random generator, a xorshift64*
+ * that is much cheaper than rand() and has no state shared with the
+ * application. Must be called with interrupts disabled. */
+uint64_t
+thread_random(void)
+{
+	random_state ^= random_state >> 12;
+	random_state ^= random_state << 25;
+	random_state ^= random_state >> 27;
+	return random_state * 0x2545f4914f6cdd1dull;
+}
+
+/* Return a random number in [0, bound), using a multiply instead of a
+ * division to reduce the range. */
+unsigned
+thread_random_below(unsigned bound)
+{
+	return (unsigned)(((thread_random() >> 32) * bound) >> 32);
+}
+
+static uint64_t
+thread_clock(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Return the CPU time used by the kernel thread of carrier c, of which the
+ * thread running on it has all since it got the CPU. */
+static uint64_t
+thread_cpu_clock(struct carrier *c)
+{
+	struct timespec ts;
+	clock_gettime(c->cpu_clock, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Return the CPU time that the running thread t used since its stamp and
+ * restart it, for the scheduler hooks. Time during which the kernel ran
+ * something else on the carrier's CPU is not charged to t. */
+static uint64_t
+thread_lap(struct thread *t)
+{
+	uint64_t now = thread_cpu_clock(carrier_self());
+	uint64_t ret = now - t->stamp;
+
+	t->stamp = now;
+	return ret;
+}
+
+/* Return how long the blocked thread t has been asleep, on the wall clock
+ * since it blocked on one carrier and may be woken up on another. */
+static uint64_t
+thread_slept(struct thread *t)
+{
+	return thread_clock() - t->stamp;
+}
+
+/* Return the number of threads waiting for the CPU. Must be called with
+ * interrupts disabled. */
+int
+thread_nr_ready(void)
+{
+	return nr_ready;
+}
+
+/* Hand a thread that was made ready to the scheduler, and let idle carriers
+ * and stopped ticks know that it is waiting. */
+static void
+thread_ready(struct thread *t)
+{
+	scheduler->enqueue(t);
+	carrier_kick();
+	if (nr_ready++ == 0) {
+		interrupt_resume();
+	}
+}
+
+/* Take the next thread to run from the scheduler, or NULL if none is ready. */
+static struct thread *
+thread_next(void)
+{
+	struct thread *t = scheduler->dequeue();
+
+	if (t != NULL) {
+		nr_ready--;
+	}
+	return t;
+}
+
+/* Clear the state that schedulers keep in every thread, so that a new
+ * scheduler starts from scratch. Used by scheduler_init and
+ * scheduler_switch. */
+void
+thread_sched_reset(void)
+{
+	// the stamp of a blocked thread is on the wall clock, see thread_slept
+	uint64_t now = thread_clock();
+
+	assert(!interrupt_enabled());
+	for (int i = 0; i < table_size; i++) {
+		struct thread *t = all_threads[i];
+		if (t == NULL) {
+			continue;
+		}
+		t->vruntime = 0;
+		t->level = 0;
+		t->level_ticks = 0;
+		t->slot = -1;
+		t->stamp = now;
+	}
+	// and that of a running thread on the CPU clock of its carrier
+	for (int i = 0; i < nr_carriers; i++) {
+		struct carrier *c = carrier_get(i);
+		if (c->current != NULL && c->current != c->idle) {
+			c->current->stamp = thread_cpu_clock(c);
+		}
+	}
+}
+
 /* Return the thread structure of the thread with identifier tid, or NULL if 
  * does not exist. Used by thread_yield and thread_wait's placeholder 
- * implementation.
+ * implementation, and by schedulers that locate threads by tid.
  */
-static struct thread * 
+struct thread * 
 thread_get(Tid tid)
 {
-	if(available_ids[tid] == 1){
+	if (tid < 0 || tid >= next_tid) {
 		return NULL;
 	}
-	else{
-		struct thread *target = all_threads[tid];
-		if(target == NULL){
-			assert(false);
-		}
-		return target;
+	return all_threads[tid];
+}
+
+/* Double the thread table (and the free Tid stack with it), without going
+ * past max_threads. Returns 0 on success, or THREAD_NOMEMORY.
+ */
+static int
+thread_table_grow(void)
+{
+	int size = table_size * 2 < max_threads ? table_size * 2 : max_threads;
+	struct thread **table;
+	Tid *tids;
+	uint32_t *gens;
+
+	assert(size > table_size);
+	table = realloc(all_threads, size * sizeof(struct thread *));
+	if (table == NULL) {
+		return THREAD_NOMEMORY;
+	}
+	all_threads = table;
+	for (int i = table_size; i < size; i++) {
+		all_threads[i] = NULL;
+	}
+
+	tids = realloc(free_tids, size * sizeof(Tid));
+	if (tids == NULL) {
+		return THREAD_NOMEMORY;
+	}
+	free_tids = tids;
+
+	gens = realloc(generations, size * sizeof(uint32_t));
+	if (gens == NULL) {
+		return THREAD_NOMEMORY;
+	}
+	generations = gens;
+	for (int i = table_size; i < size; i++) {
+		generations[i] = 1;
+	}
+	table_size = size;
+	return 0;
+}
+
+/* Reserve a Tid for a new thread. Returns the Tid, THREAD_NOMORE when
+ * max_threads are in use, or THREAD_NOMEMORY if the table cannot grow.
+ */
+static Tid
+tid_alloc(void)
+{
+	if (nr_free_tids > 0) {
+		return free_tids[--nr_free_tids];
+	}
+	if (next_tid >= max_threads) {
+		return THREAD_NOMORE;
+	}
+	if (next_tid == table_size && thread_table_grow() != 0) {
+		return THREAD_NOMEMORY;
+	}
+	return next_tid++;
+}
+
+/* Remove tid from the thread table and make it available for reuse. */
+static void
+tid_free(Tid tid)
+{
+	assert(tid >= 0 && tid < next_tid);
+	all_threads[tid] = NULL;
+	free_tids[nr_free_tids++] = tid;
+	// 0 is reserved so that no valid handle is 0
+	if (++generations[tid] == 0) {
+		generations[tid] = 1;
+	}
+}
+
+/* Return the Tid packed in handle if its generation is still current, or
+ * THREAD_INVALID. Must be called with interrupts disabled.
+ */
+static Tid
+handle_get(thread_handle_t handle)
+{
+	Tid tid = (Tid)(uint32_t)handle;
+	uint32_t generation = (uint32_t)(handle >> 32);
+
+	if (tid < 0 || thread_get(tid) == NULL ||
+	    generations[tid] != generation) {
+		return THREAD_INVALID;
 	}
+	return tid;
 }
 
 /* Return whether the thread with identifier tid is runnable.
@@ -106,32 +531,147 @@ thread_runnable(Tid tid)
 	return ((target->state) == runnable) || ((target->state) == running);
 }
 
-/* Context switch to the next thread. Used by thread_yield. */
+/* Make t the owner of the shared stack: copy the live frames of the current
+ * owner (unless it has exited) out to its buffer, and copy t's frames in.
+ * Must not run on the shared stack.
+ */
+static void
+shared_stack_load(struct thread *t)
+{
+	void *top = stack_top(shared_stack, shared_size);
+	struct thread *owner = shared_owner;
+
+	if (owner != NULL && owner->state != zombie) {
+		size_t size = (char *)top - (char *)owner->saved_sp;
+		owner->saved_stack = stack_save_resize(owner->saved_stack,
+		                                       &(owner->saved_capacity), size);
+		assert(owner->saved_stack != NULL);
+		memcpy(owner->saved_stack, owner->saved_sp, size);
+	}
+	memcpy(t->saved_sp, t->saved_stack, (char *)top - (char *)t->saved_sp);
+	shared_owner = t;
+}
+
+/* Entry point of the switcher context, resumed by thread_switch whenever a
+ * thread running on the shared stack hands over to a different shared-stack
+ * thread. current_thread is already the next thread at that point.
+ */
+static void
+thread_switcher(void *unused0, void *unused1)
+{
+	(void)unused0;
+	(void)unused1;
+	while (1) {
+		shared_stack_load(current_thread);
+		context_switch(&switcher_sp, current_thread->saved_sp);
+	}
+}
+
+/* Map the shared stack and the switcher's stack, if not done yet. Returns 0
+ * on success, or THREAD_NOMEMORY.
+ */
+static int
+shared_stack_init(void)
+{
+	if (shared_stack != NULL) {
+		return 0;
+	}
+	switcher_stack = stack_alloc(stack_round(THREAD_SMALL_STACK));
+	if (switcher_stack == NULL) {
+		return THREAD_NOMEMORY;
+	}
+	shared_stack = stack_alloc(shared_size);
+	if (shared_stack == NULL) {
+		stack_free(switcher_stack, stack_round(THREAD_SMALL_STACK));
+		switcher_stack = NULL;
+		return THREAD_NOMEMORY;
+	}
+	switcher_sp = context_init(stack_top(switcher_stack,
+	                                     stack_round(THREAD_SMALL_STACK)),
+	                           thread_switcher, NULL, NULL);
+	shared_owner = NULL;
+	return 0;
+}
+
+/* Count a missed deadline the first time the thread is found past it: when
+ * it gets the CPU, when it exits, or when its deadline is replaced. */
+static void
+thread_check_deadline(struct thread *t)
+{
+	if (t->deadline != 0 && !t->deadline_missed &&
+	    thread_clock() > t->deadline) {
+		t->deadline_missed = true;
+		deadline_misses++;
+	}
+}
+
+static void thread_stack_put(void *stack, size_t size, int node);
+
+/* Release the stack of the thread that the carrier switched away from in
+ * thread_exit, now that the switch is done and nothing runs on it. Called
+ * by whatever the carrier resumed. */
+static void
+thread_release_exited(void)
+{
+	struct carrier *c = carrier_self();
+	struct thread *dead = c->exited;
+
+	if (dead == NULL) {
+		return;
+	}
+	c->exited = NULL;
+	if (dead->stack_pointer != NULL) {
+		thread_stack_put(dead->stack_pointer, dead->stack_size, dead->node);
+		dead->stack_pointer = NULL;
+		dead->stack_size = 0;
+		dead->node = -1;
+	}
+	// the frames of a shared-stack zombie are dead as well
+	if (dead->saved_stack != NULL) {
+		stack_save_free(dead->saved_stack, dead->saved_capacity);
+		dead->saved_stack = NULL;
+		dead->saved_capacity = 0;
+	}
+}
+
+/* Context switch to the next thread. Used by thread_yield. Must be called
+ * with interrupts disabled; the signal mask is not part of the saved context,
+ * so the caller restores its own interrupt state once the switch returns.
+ */
 static void
 thread_switch(struct thread * next)
 {
-	volatile int flag = 0;
-	getcontext(&(current_thread->my_context));
-	
-	if (flag == 0){
-		flag = 1;
-		previous_thread = current_thread;
-		current_thread = next;
-		current_thread->state = running;
-		setcontext(&(current_thread->my_context));
+	struct carrier *c = carrier_self();
+	struct thread *previous_thread = c->current;
+
+	assert(!interrupt_enabled());
+	if (previous_thread == c->idle) {
+		busy_carriers++;
+	} else if (next == c->idle) {
+		busy_carriers--;
+	}
+	c->current = next;
+	next->state = running;
+	thread_check_deadline(next);
+	if (scheduler->timed) {
+		next->stamp = thread_cpu_clock(c);
 	}
-	else{
-		if (previous_thread->state == zombie){
-			if(previous_thread->stack_pointer != NULL){
-				free(previous_thread->stack_pointer);
-				previous_thread->stack_pointer = NULL;
-			}
-		}
 
-		if(current_thread->is_killed){
-			current_thread->exit_code = THREAD_KILLED;
-			thread_exit(THREAD_KILLED);
-		}
+	if (!next->shared_stack || next == shared_owner) {
+		context_switch(&(previous_thread->saved_sp), next->saved_sp);
+	} else if (previous_thread == shared_owner) {
+		// we are on the shared stack, let the switcher swap the frames
+		context_switch(&(previous_thread->saved_sp), switcher_sp);
+	} else {
+		shared_stack_load(next);
+		context_switch(&(previous_thread->saved_sp), next->saved_sp);
+	}
+
+	interrupt_switched();
+	thread_release_exited();
+	if(current_thread->is_killed){
+		current_thread->exit_code = THREAD_KILLED;
+		thread_exit(THREAD_KILLED);
 	}
 }
 
@@ -154,27 +694,38 @@ thread_yield(Tid want_tid)
 
     // Case 2: Yield to any available thread
     if (want_tid == THREAD_ANY) {
-        struct thread *next_thread = scheduler->dequeue();
+        struct thread *next_thread = thread_next();
+		if (next_thread == NULL && current_thread->state == blocked &&
+		    busy_carriers > 1) {
+			// a thread on another carrier may still wake us up
+			next_thread = carrier_self()->idle;
+		}
         if (next_thread != NULL) {
 			if(current_thread->state != blocked){
+				if (scheduler->on_yield != NULL) {
+					scheduler->on_yield(current_thread,
+					                    thread_lap(current_thread));
+				}
 				current_thread->state = runnable;
-				scheduler->enqueue(current_thread);
+				thread_ready(current_thread);
+			} else if (scheduler->timed) {
+				if (scheduler->on_block != NULL) {
+					scheduler->on_block(current_thread,
+					                    thread_lap(current_thread));
+				}
+				// on_wake times the sleep from here
+				current_thread->stamp = thread_clock();
 			}
             thread_switch(next_thread);
 			interrupt_set(enabled);
-            return next_thread->id;
+			// the idle loop has no Tid to report
+			return next_thread->id >= 0 ? next_thread->id : thread_id();
         }
 		interrupt_set(enabled);
         return THREAD_NONE;
     }
 
-    // Case 3: Invalid tid range
-    if (want_tid < 0 || want_tid >= THREAD_MAX_THREADS) {
-		interrupt_set(enabled);
-        return THREAD_INVALID;
-    }
-
-    // Case 4: Check if target exists and is runnable
+    // Case 3/4: Check if target exists and is runnable
     struct thread *target = thread_get(want_tid);
     if (target == NULL || !thread_runnable(want_tid)) {
 		interrupt_set(enabled);
@@ -187,41 +738,380 @@ thread_yield(Tid want_tid)
 		interrupt_set(enabled);
         return THREAD_INVALID;
     }
+	nr_ready--;
 
     // Only modify current thread state and scheduler if we're sure we can switch
+	if (scheduler->on_yield != NULL) {
+		scheduler->on_yield(current_thread, thread_lap(current_thread));
+	}
     current_thread->state = runnable;
-    scheduler->enqueue(current_thread);
+    thread_ready(current_thread);
     thread_switch(scheduled_target);
 	interrupt_set(enabled);
     return want_tid;
 }
 
+/* Called on each timer interrupt. Unlike thread_yield(THREAD_ANY), the
+ * current thread competes with the ready threads, so it keeps running if the
+ * scheduler still considers it the best choice.
+ */
+void
+thread_preempt(void)
+{
+	int enabled = interrupt_off();
+	struct thread *next_thread;
+
+	assert(current_thread->state == running);
+	if (scheduler->on_tick != NULL) {
+		scheduler->on_tick(current_thread, thread_lap(current_thread));
+	}
+	// the number of ready threads stays the same
+	current_thread->state = runnable;
+	scheduler->enqueue(current_thread);
+	next_thread = scheduler->dequeue();
+	assert(next_thread != NULL);
+	if (next_thread == current_thread) {
+		current_thread->state = running;
+		if (scheduler->timed) {
+			current_thread->stamp = thread_cpu_clock(carrier_self());
+		}
+	} else {
+		carrier_kick();
+		thread_switch(next_thread);
+	}
+	interrupt_set(enabled);
+}
+
+/* Change the priority that a thread runs at, requeueing a ready thread so
+ * that it moves to its new level. */
+static void
+thread_set_effective(struct thread *t, int prio)
+{
+	if (t->priority == prio) {
+		return;
+	}
+	if (t->state == runnable && scheduler->remove(t->id) != NULL) {
+		t->priority = prio;
+		scheduler->enqueue(t);
+	} else {
+		t->priority = prio;
+	}
+}
+
+static int thread_inherited_prio(struct thread *t);
+static void lock_reinherit(fifo_queue_t *queue);
+
+int
+thread_setprio(Tid tid, int prio)
+{
+	int enabled = interrupt_off();
+	struct thread *target = thread_get(tid);
+
+	if (target == NULL || prio < 0 || prio >= THREAD_PRIO_LEVELS) {
+		interrupt_set(enabled);
+		return THREAD_INVALID;
+	}
+
+	target->base_priority = prio;
+	thread_set_effective(target, thread_inherited_prio(target));
+	if (target->state == blocked) {
+		// what the threads it waits for inherit from it has changed
+		lock_reinherit(target->waiting_for_queue);
+	}
+	interrupt_set(enabled);
+	return 0;
+}
+
+int
+thread_getprio(Tid tid)
+{
+	int enabled = interrupt_off();
+	struct thread *target = thread_get(tid);
+	int prio = target != NULL ? target->priority : THREAD_INVALID;
+
+	interrupt_set(enabled);
+	return prio;
+}
+
+int
+thread_set_tickets(Tid tid, int tickets)
+{
+	int enabled = interrupt_off();
+	struct thread *target = thread_get(tid);
+
+	if (target == NULL || tickets < 1 || tickets > THREAD_TICKETS_MAX) {
+		interrupt_set(enabled);
+		return THREAD_INVALID;
+	}
+
+	// requeue a ready thread so that the scheduler sees its new share
+	if (target->state == runnable && scheduler->remove(tid) != NULL) {
+		target->tickets = tickets;
+		scheduler->enqueue(target);
+	} else {
+		target->tickets = tickets;
+	}
+	interrupt_set(enabled);
+	return 0;
+}
+
+int
+thread_get_tickets(Tid tid)
+{
+	int enabled = interrupt_off();
+	struct thread *target = thread_get(tid);
+	int tickets = target != NULL ? target->tickets : THREAD_INVALID;
+
+	interrupt_set(enabled);
+	return tickets;
+}
+
+int
+thread_set_deadline(Tid tid, uint64_t abs_ns)
+{
+	int enabled = interrupt_off();
+	struct thread *target = thread_get(tid);
+
+	if (target == NULL) {
+		interrupt_set(enabled);
+		return THREAD_INVALID;
+	}
+	thread_check_deadline(target);
+
+	// requeue a ready thread so that it moves to its new place
+	if (target->state == runnable && scheduler->remove(tid) != NULL) {
+		target->deadline = abs_ns;
+		target->deadline_missed = false;
+		scheduler->enqueue(target);
+	} else {
+		target->deadline = abs_ns;
+		target->deadline_missed = false;
+	}
+	interrupt_set(enabled);
+	return 0;
+}
+
+int
+thread_set_quantum(Tid tid, unsigned quantum)
+{
+	int enabled = interrupt_off();
+	struct thread *target = thread_get(tid);
+
+	if (target == NULL) {
+		interrupt_set(enabled);
+		return THREAD_INVALID;
+	}
+	target->quantum = quantum;
+	// takes effect now if target is running here, else when it next runs
+	interrupt_tune();
+	interrupt_set(enabled);
+	return 0;
+}
+
+unsigned
+thread_get_quantum(Tid tid)
+{
+	int enabled = interrupt_off();
+	struct thread *target = thread_get(tid);
+	unsigned quantum = target != NULL ? target->quantum : 0;
+
+	interrupt_set(enabled);
+	return quantum;
+}
+
+unsigned long
+thread_deadline_misses(void)
+{
+	int enabled = interrupt_off();
+	unsigned long ret = deadline_misses;
+
+	interrupt_set(enabled);
+	return ret;
+}
+
+/* Release the stack, wait queue and structure of a thread for good. */
+static void
+thread_free(struct thread * dead)
+{
+	if (dead->stack_pointer != NULL){
+		stack_free(dead->stack_pointer, dead->stack_size);
+		dead->stack_pointer = NULL;
+	}
+	if (dead->saved_stack != NULL){
+		stack_save_free(dead->saved_stack, dead->saved_capacity);
+		dead->saved_stack = NULL;
+	}
+	if (dead->wait_queue != NULL){
+		queue_destroy(dead->wait_queue);
+		dead->wait_queue = NULL;
+	}
+	free(dead);
+}
+
+/* Move the stack of t to NUMA node node, unless node is -1 or it is there
+ * already. */
+static void
+thread_place(struct thread *t, int node)
+{
+	if (node >= 0 && t->node != node && t->stack_pointer != NULL &&
+	    stack_bind(t->stack_pointer, t->stack_size, node) == 0) {
+		t->node = node;
+	}
+}
+
+/* Put the stack of an exited thread in the stack cache, or unmap it if the
+ * cache is full. */
+static void
+thread_stack_put(void *stack, size_t size, int node)
+{
+	struct cached_stack *s;
+
+	if (stack_cache_count >= cache_high) {
+		while (stack_cache_count > cache_low) {
+			s = stack_cache;
+			stack_cache = s->next;
+			stack_cache_count--;
+			stack_free(s->stack, s->size);
+		}
+		if (stack_cache_count >= cache_high) {
+			stack_free(stack, size);
+			return;
+		}
+	}
+	s = (struct cached_stack *)stack_top(stack, size) - 1;
+	s->stack = stack;
+	s->size = size;
+	s->node = node;
+	s->next = stack_cache;
+	stack_cache = s;
+	stack_cache_count++;
+}
+
+/* Give t a stack of size bytes on NUMA node node, if not -1. A cached stack
+ * of the right size is preferred, on the right node if possible. Returns 0
+ * on success, or -1 when out of memory. */
+static int
+thread_stack_get(struct thread *t, size_t size, int node)
+{
+	struct cached_stack **prev = NULL;
+
+	for (struct cached_stack **link = &stack_cache; *link != NULL;
+	     link = &(*link)->next) {
+		if ((*link)->size != size) {
+			continue;
+		}
+		if (prev == NULL || (*link)->node == node) {
+			prev = link;
+		}
+		if ((*link)->node == node) {
+			break;
+		}
+	}
+	if (prev != NULL) {
+		struct cached_stack *s = *prev;
+		*prev = s->next;
+		stack_cache_count--;
+		t->stack_pointer = s->stack;
+		t->node = s->node;
+	} else {
+		t->stack_pointer = stack_alloc(size);
+		t->node = -1;
+		if (t->stack_pointer == NULL) {
+			return -1;
+		}
+	}
+	t->stack_size = size;
+	thread_place(t, node);
+	return 0;
+}
+
+/* Return a thread structure with a stack of stack_size bytes (none if 0, for
+ * shared-stack threads) and an empty wait queue, taken from the caches when
+ * possible. The stack is put on NUMA node node, if not -1. Returns NULL when
+ * out of memory.
+ */
+static struct thread *
+thread_alloc(size_t stack_size, int node)
+{
+	struct thread *t = thread_cache;
+
+	if (t != NULL) {
+		thread_cache = t->next;
+		cache_count--;
+		t->next = NULL;
+	} else {
+		t = malloc(sizeof(struct thread));
+		if (t == NULL) {
+			return NULL;
+		}
+		t->self = t;
+		t->saved_stack = NULL;
+		t->saved_capacity = 0;
+		t->wait_queue = queue_create(max_threads);
+		if (t->wait_queue == NULL) {
+			free(t);
+			return NULL;
+		}
+		queue_set_owner(t->wait_queue, &(t->self));
+	}
+	t->stack_pointer = NULL;
+	t->stack_size = 0;
+	t->node = -1;
+	if (stack_size != 0 && thread_stack_get(t, stack_size, node) != 0) {
+		thread_free(t);
+		return NULL;
+	}
+	return t;
+}
+
 /* Fully clean up a thread structure and make its tid available for reuse.
+ * Its wait queue goes back to the cache together with the structure; its
+ * stack went to the stack cache when it exited, see thread_release_exited.
  * Used by thread_wait's placeholder implementation
  */
 static void
 thread_destroy(struct thread * dead)
 {
-	assert(dead->stack_pointer == NULL);
-	assert(dead->wait_queue == NULL);
-	available_ids[dead->id] = 1;
-	all_threads[dead->id] = NULL;
-    free(dead);
+	assert(dead != current_thread);
+	assert(dead->wait_queue == NULL || queue_count(dead->wait_queue) == 0);
+	tid_free(dead->id);
+	if (dead == shared_owner) {
+		shared_owner = NULL;
+	}
+
+	if (dead->wait_queue == NULL) {
+		thread_free(dead);
+		return;
+	}
+
+	if (cache_count >= cache_high) {
+		while (cache_count > cache_low) {
+			struct thread *t = thread_cache;
+			thread_cache = t->next;
+			cache_count--;
+			thread_free(t);
+		}
+		if (cache_count >= cache_high) {
+			thread_free(dead);
+			return;
+		}
+	}
+	dead->next = thread_cache;
+	thread_cache = dead;
+	cache_count++;
 }
 
 /* New thread starts by calling thread_stub. The arguments to thread_stub are
  * the thread_main() function, and one argument to the thread_main() function. 
  */
 static void
-thread_stub(int (*thread_main)(void *), void *arg)
+thread_stub(void *fn, void *arg)
 {
+	thread_entry_f thread_main = (thread_entry_f)fn;
+
+	interrupt_switched();
+	thread_release_exited();
 	interrupt_on();
-	if (previous_thread->state == zombie){
-		if (previous_thread->stack_pointer != NULL){
-			free(previous_thread->stack_pointer);
-			previous_thread->stack_pointer = NULL;
-		}
-	}
 	if (current_thread->is_killed){
 		current_thread->exit_code = THREAD_KILLED;
 		thread_exit(THREAD_KILLED);
@@ -236,77 +1126,98 @@ thread_stub(int (*thread_main)(void *), void *arg)
 Tid
 thread_create(int (*fn)(void *), void *parg)
 {
+	return thread_create_attr(fn, parg, NULL);
+}
+
+Tid
+thread_create_attr(int (*fn)(void *), void *parg,
+                   const struct thread_attr *attr)
+{
+	bool shared = attr != NULL && attr->shared_stack;
+	size_t stack_size = THREAD_MIN_STACK;
+	if (attr != NULL && attr->stack_size != 0) {
+		stack_size = attr->stack_size;
+	}
+	stack_size = shared ? 0 : stack_round(stack_size);
+
 	int enabled = interrupt_off();
+	// the shared stack can only hold the frames of one running thread
+	if (shared && nr_carriers > 1) {
+		interrupt_set(enabled);
+		return THREAD_INVALID;
+	}
+	if (shared && shared_stack_init() != 0) {
+		interrupt_set(enabled);
+		return THREAD_NOMEMORY;
+	}
     // Find an available thread ID
-    int tid = -1;
-    for (int i = 0; i < THREAD_MAX_THREADS; i++) {
-        if (available_ids[i] == 1) {
-            tid = i;
-            available_ids[i] = 0;
-            break;
-        }
-    }
-    if (tid == -1) {
+    Tid tid = tid_alloc();
+    if (tid < 0) {
 		interrupt_set(enabled);
-        return THREAD_NOMORE;
+        return tid;
     }
 
-    // Allocate memory for the new thread
-    struct thread *new_thread = malloc(sizeof(struct thread));
+    // Get a structure, stack and wait queue for the new thread
+    // on the node of the creating carrier, which first runs it
+    struct thread *new_thread = thread_alloc(stack_size, carrier_self()->node);
     if (new_thread == NULL) {
-		available_ids[tid] = 1;
+		tid_free(tid);
 		interrupt_set(enabled);
         return THREAD_NOMEMORY;
     }
 
-	new_thread->self = new_thread;
-
-    // Allocate stack for the new thread
-    void *stack = malloc(THREAD_MIN_STACK);
-    if (stack == NULL) {
-		available_ids[tid] = 1;
-        free(new_thread);
-		interrupt_set(enabled);
-        return THREAD_NOMEMORY;
-    }
-
-	new_thread->wait_queue = queue_create(THREAD_MAX_THREADS);
-	queue_set_owner(new_thread->wait_queue, &(new_thread->self));
-	if (new_thread->wait_queue == NULL) {
-		free(new_thread->wait_queue);
-		new_thread->wait_queue = NULL;
-		interrupt_set(enabled);
-		return THREAD_NOMEMORY;
-	}
-
     // Initialize the new thread
-    new_thread->id = tid;
+    node_init(new_thread, tid);
+    new_thread->next = NULL;
+    new_thread->prev = NULL;
     new_thread->state = runnable;
     new_thread->is_killed = false;
+	new_thread->priority = THREAD_PRIO_DEFAULT;
+	new_thread->base_priority = THREAD_PRIO_DEFAULT;
+	new_thread->held_locks = NULL;
+	new_thread->sched_node = (struct heap_node){ 0 };
+	new_thread->vruntime = 0;
+	new_thread->tickets = THREAD_TICKETS_DEFAULT;
+	new_thread->quantum = 0;
+	new_thread->level = 0;
+	new_thread->level_ticks = 0;
+	new_thread->level_epoch = 0;
+	new_thread->deadline = 0;
+	new_thread->deadline_missed = false;
+	new_thread->slot = -1;
+	new_thread->stamp = 0;
 	new_thread->late_waiter_succeed = false;
-	new_thread->stack_pointer = stack;
 	new_thread->waiting_for_queue = NULL;
+	new_thread->shared_stack = shared;
+
+    // Set up the initial frame so the first switch to it calls thread_stub
+	if (shared) {
+		// build the frame aside and keep it in the buffer until first run
+		struct context_frame frame __attribute__((aligned(16)));
+		void *sp = context_init(&frame + 1, thread_stub, (void *)fn, parg);
+		assert(sp == &frame);
+		new_thread->saved_stack = stack_save_resize(new_thread->saved_stack,
+		                                 &(new_thread->saved_capacity),
+		                                 sizeof(frame));
+		if (new_thread->saved_stack == NULL) {
+			thread_free(new_thread);
+			tid_free(tid);
+			interrupt_set(enabled);
+			return THREAD_NOMEMORY;
+		}
+		memcpy(new_thread->saved_stack, &frame, sizeof(frame));
+		new_thread->saved_sp = (char *)stack_top(shared_stack, shared_size)
+		                       - sizeof(frame);
+	} else {
+		new_thread->saved_sp = context_init(stack_top(new_thread->stack_pointer,
+		                                              new_thread->stack_size),
+		                                    thread_stub, (void *)fn, parg);
+	}
 
-    // Set up the context for the new thread
-    getcontext(&new_thread->my_context);
-
-	// don't automatically switch context when thread exits
-	new_thread->my_context.uc_link = NULL;
-	// instruction pointer
-	new_thread->my_context.uc_mcontext.gregs[REG_RIP] = (greg_t)&thread_stub;
-	// stack pointer
-    new_thread->my_context.uc_mcontext.gregs[REG_RSP] = (greg_t)(stack + THREAD_MIN_STACK - 8);
-	// first argument register (first argument of stub)
-    new_thread->my_context.uc_mcontext.gregs[REG_RDI] = (greg_t)fn;
-	// second argument register (second argument of stub)
-    new_thread->my_context.uc_mcontext.gregs[REG_RSI] = (greg_t)parg;
-	// stack is valid to use
-	new_thread->my_context.uc_flags = 0;
-	
     // Add the new thread to the all_threads array
     all_threads[tid] = new_thread;
 
-    scheduler->enqueue(new_thread);
+    thread_ready(new_thread);
 
 	interrupt_set(enabled);
     return tid;
@@ -316,10 +1227,6 @@ Tid
 thread_kill(Tid tid)
 {
 	int enabled = interrupt_off();
-	if(tid < 0 || tid >= THREAD_MAX_THREADS){
-		interrupt_set(enabled);
-		return THREAD_INVALID;
-	}
 	if (tid == thread_id()) {
 		interrupt_set(enabled);
 		return THREAD_INVALID;
@@ -332,10 +1239,11 @@ thread_kill(Tid tid)
 	}
 
 	if (victim_thread->state == blocked){
-		queue_remove(victim_thread->waiting_for_queue, tid);
-		victim_thread->waiting_for_queue = NULL;
-		victim_thread->state = runnable;
-		scheduler->enqueue(victim_thread);
+		fifo_queue_t *queue = victim_thread->waiting_for_queue;
+		queue_remove_node(queue, victim_thread);
+		thread_wake(victim_thread);
+		// the threads it waited for no longer inherit its priority
+		lock_reinherit(queue);
 	}
 
 	victim_thread->is_killed = true; // Mark the thread as killed
@@ -347,7 +1255,10 @@ thread_kill(Tid tid)
 void
 thread_exit(int exit_code)
 {
-	int enabled = interrupt_off();
+	// interrupts stay off: the next thread restores its own state
+	interrupt_off();
+	// a thread that finishes late never gets the CPU again to notice
+	thread_check_deadline(current_thread);
 	// Find the next runnable thread
 	current_thread->exit_code = exit_code;
 	current_thread->state = zombie;
@@ -358,10 +1269,17 @@ thread_exit(int exit_code)
 	else{
 		current_thread->late_waiter_succeed = false;
 	}
-	struct thread *next_thread = scheduler->dequeue();
+	if (scheduler->on_exit != NULL) {
+		scheduler->on_exit(current_thread, thread_lap(current_thread));
+	}
+	struct thread *next_thread = thread_next();
 
+	if (next_thread == NULL && busy_carriers > 1) {
+		next_thread = carrier_self()->idle;
+	}
 	if (next_thread != NULL) {
-		interrupt_set(enabled);
+		// whatever runs next releases our stack, see thread_release_exited
+		carrier_self()->exited = current_thread;
 		thread_switch(next_thread);
 		assert(false);
 	}
@@ -369,6 +1287,26 @@ thread_exit(int exit_code)
 	assert(false);
 }
 
+/* The loop that a carrier runs whenever it has no user thread to run: take
+ * the next ready thread, or sleep until another carrier makes one ready.
+ * Entered with interrupts disabled, and runs with them disabled. */
+void
+thread_idle(void)
+{
+	assert(current_thread == carrier_self()->idle);
+	thread_release_exited();
+	while (1) {
+		struct thread *next_thread = thread_next();
+		if (next_thread != NULL) {
+			interrupt_idle(false);
+			thread_switch(next_thread);
+		} else {
+			interrupt_idle(true);
+			carrier_park();
+		}
+	}
+}
+
 /* Clean-up logic to unload the threading system. Used by ut369.c. You may 
  * assume all threads are either freed or in the zombie state when this is 
  * called.
@@ -376,29 +1314,52 @@ thread_exit(int exit_code)
 void
 thread_end(void)
 {
-	if (current_thread->stack_pointer != NULL){
-		free(current_thread->stack_pointer);
-		current_thread->stack_pointer = NULL;
+    for (int i = 0; i < next_tid; i++) {
+        struct thread *t = all_threads[i];
+        if (t != NULL) {
+			// threads may still be blocked on it, so skip queue_destroy
+			free(t->wait_queue);
+			t->wait_queue = NULL;
+			all_threads[i] = NULL;
+			thread_free(t);
+        }
+    }
+	free(all_threads);
+	all_threads = NULL;
+	free(free_tids);
+	free_tids = NULL;
+	free(generations);
+	generations = NULL;
+	nr_free_tids = 0;
+	table_size = 0;
+	next_tid = 0;
+
+	while (thread_cache != NULL) {
+		struct thread *t = thread_cache;
+		thread_cache = t->next;
+		thread_free(t);
 	}
-
-	if (current_thread->wait_queue != NULL){
-		free(current_thread->wait_queue);
-		current_thread->wait_queue = NULL;
+	cache_count = 0;
+	while (stack_cache != NULL) {
+		struct cached_stack *s = stack_cache;
+		stack_cache = s->next;
+		stack_free(s->stack, s->size);
+	}
+	stack_cache_count = 0;
+
+	if (shared_stack != NULL) {
+		stack_free(shared_stack, shared_size);
+		stack_free(switcher_stack, stack_round(THREAD_SMALL_STACK));
+		shared_stack = NULL;
+		switcher_stack = NULL;
+		shared_owner = NULL;
 	}
 
-    for (int i = 0; i < THREAD_MAX_THREADS; i++) {
-        if (all_threads[i] != NULL) {
-			if (all_threads[i]->stack_pointer != NULL){
-				free(all_threads[i]->stack_pointer);
-				all_threads[i]->stack_pointer = NULL;
-			}
-			if (all_threads[i]->wait_queue != NULL){
-				free(all_threads[i]->wait_queue);
-				all_threads[i]->wait_queue = NULL;
-			}
-            thread_destroy(all_threads[i]);
-        }
-    }
+	signal(SIGSEGV, SIG_DFL);
+	segv_stack.ss_flags = SS_DISABLE;
+	sigaltstack(&segv_stack, NULL);
+	free(segv_stack.ss_sp);
+	segv_stack.ss_sp = NULL;
 }
 
 /**************************************************************************
@@ -412,7 +1373,7 @@ thread_wait(Tid tid, int *exit_code)
 	int enabled = interrupt_off();
 	
 	// Check for invalid conditions
-	if (tid < 0 || tid >= THREAD_MAX_THREADS || tid == thread_id()) {
+	if (tid == thread_id()) {
 		interrupt_set(enabled);
 		return THREAD_INVALID;
 	}
@@ -444,14 +1405,6 @@ thread_wait(Tid tid, int *exit_code)
 			*exit_code = target->exit_code;
 		}
 		if (target->reapers == 1){
-			if (target->stack_pointer != NULL){
-				free(target->stack_pointer);
-				target->stack_pointer = NULL;
-			}
-			if (target->wait_queue != NULL){
-				queue_destroy(target->wait_queue);
-				target->wait_queue = NULL;
-			}
 			thread_destroy(target);
 			interrupt_set(enabled);
 			return tid;
@@ -465,14 +1418,6 @@ thread_wait(Tid tid, int *exit_code)
 			if (exit_code != NULL) {
 				*exit_code = target->exit_code;
 			}
-			if (target->stack_pointer != NULL){
-				free(target->stack_pointer);
-				target->stack_pointer = NULL;
-			}
-			if(target->wait_queue != NULL){
-				queue_destroy(target->wait_queue);
-				target->wait_queue = NULL;
-			}
 			thread_destroy(target);
 			interrupt_set(enabled);
 			return tid;
@@ -485,6 +1430,68 @@ thread_wait(Tid tid, int *exit_code)
 }
 
 
+thread_handle_t
+thread_handle(Tid tid)
+{
+	int enabled = interrupt_off();
+	thread_handle_t handle = 0;
+
+	if (thread_get(tid) != NULL) {
+		handle = ((thread_handle_t)generations[tid] << 32) | (uint32_t)tid;
+	}
+	interrupt_set(enabled);
+	return handle;
+}
+
+Tid
+thread_handle_tid(thread_handle_t handle)
+{
+	int enabled = interrupt_off();
+	Tid tid = handle_get(handle);
+	interrupt_set(enabled);
+	return tid;
+}
+
+/* The handle is validated and used with interrupts disabled, so its Tid
+ * cannot be reaped and reused in between.
+ */
+Tid
+thread_kill_handle(thread_handle_t handle)
+{
+	int enabled = interrupt_off();
+	Tid tid = handle_get(handle);
+	if (tid >= 0) {
+		tid = thread_kill(tid);
+	}
+	interrupt_set(enabled);
+	return tid;
+}
+
+Tid
+thread_yield_handle(thread_handle_t handle)
+{
+	int enabled = interrupt_off();
+	Tid tid = handle_get(handle);
+	if (tid >= 0) {
+		tid = thread_yield(tid);
+	}
+	interrupt_set(enabled);
+	return tid;
+}
+
+int
+thread_wait_handle(thread_handle_t handle, int *exit_code)
+{
+	int enabled = interrupt_off();
+	Tid tid = handle_get(handle);
+	if (tid >= 0) {
+		tid = thread_wait(tid, exit_code);
+	}
+	interrupt_set(enabled);
+	return tid;
+}
+
+
 static bool can_deadlock(struct thread * target) {
 	// target is who i'm waiting for - waitee
 	struct thread *t = target;
@@ -520,12 +1527,11 @@ thread_sleep(fifo_queue_t *queue)
 	current_thread->state = blocked;
 	queue_push(queue, current_thread);
 	current_thread->waiting_for_queue = queue;
-	Tid curr_id = current_thread->id;
 
 	Tid next_tid = thread_yield(THREAD_ANY);
 
 	if (next_tid == THREAD_NONE || next_tid == THREAD_INVALID) {
-		current_thread = queue_remove(queue, curr_id);
+		queue_remove_node(queue, current_thread);
 		current_thread->state = running;
 		current_thread->waiting_for_queue = NULL;
 		return next_tid;
@@ -534,6 +1540,25 @@ thread_sleep(fifo_queue_t *queue)
 	return next_tid;
 }
 
+/* Make a thread that was popped off its wait queue runnable again. If the
+ * scheduler says it should run before the current thread, preempt the
+ * current thread as soon as interrupts are enabled again. */
+static void
+thread_wake(struct thread *woken_thread)
+{
+	assert(woken_thread->state == blocked);
+	if (scheduler->on_wake != NULL) {
+		scheduler->on_wake(woken_thread, thread_slept(woken_thread));
+	}
+	woken_thread->state = runnable;
+	thread_ready(woken_thread);
+	woken_thread->waiting_for_queue = NULL;
+	if (scheduler->preempts != NULL && current_thread->state == running &&
+	    scheduler->preempts(woken_thread, current_thread)) {
+		interrupt_preempt();
+	}
+}
+
 /* When the 'all' parameter is 1, wake up all threads waiting in the queue.
  * returns whether a thread was woken up on not. 
  */
@@ -551,20 +1576,14 @@ thread_wakeup(fifo_queue_t *queue, int all)
 	if (all == 1) {
 		woken_thread = queue_pop(queue);
 		while (woken_thread != NULL) {
-			assert(woken_thread->state == blocked);
-			woken_thread->state = runnable;
-			scheduler->enqueue(woken_thread);
-			woken_thread->waiting_for_queue = NULL;
+			thread_wake(woken_thread);
 			woken_thread = queue_pop(queue);
 			count++;
 		}
 	} else {
 		woken_thread = queue_pop(queue);
 		if (woken_thread != NULL) {
-			assert(woken_thread->state == blocked);
-			woken_thread->state = runnable;
-			scheduler->enqueue(woken_thread);
-			woken_thread->waiting_for_queue = NULL;
+			thread_wake(woken_thread);
 			count = 1;
 		}
 	}
@@ -575,8 +1594,87 @@ struct lock {
     struct thread *holder;
 	fifo_queue_t *wait_queue;
     int cv_count;
+    struct lock *next_held;   /* next lock held by the same holder */
 };
 
+/* The priority that t should run at: its own, or that of the most urgent
+ * thread waiting for a lock it holds, if more urgent. */
+static int
+thread_inherited_prio(struct thread *t)
+{
+	int prio = t->base_priority;
+
+	for (struct lock *l = t->held_locks; l != NULL; l = l->next_held) {
+		for (struct thread *w = queue_top(l->wait_queue); w != NULL;
+		     w = w->next) {
+			if (w->priority < prio) {
+				prio = w->priority;
+			}
+		}
+	}
+	return prio;
+}
+
+/* Recompute what the owner of queue inherits, after a thread waiting in it
+ * changed priority or stopped waiting, and on down the chain of threads that
+ * the owner is itself waiting for. */
+static void
+lock_reinherit(fifo_queue_t *queue)
+{
+	while (queue != NULL) {
+		struct thread *t = queue_get_owner(queue);
+		int prio;
+
+		if (t == NULL) {
+			break;
+		}
+		prio = thread_inherited_prio(t);
+		if (prio == t->priority) {
+			break;
+		}
+		thread_set_effective(t, prio);
+		queue = t->state == blocked ? t->waiting_for_queue : NULL;
+	}
+}
+
+/* Wake the most urgent thread waiting for lock, the one that waited longest
+ * among equals. */
+static void
+lock_wake_urgent(struct lock *lock)
+{
+	struct thread *urgent = queue_top(lock->wait_queue);
+
+	if (urgent == NULL) {
+		return;
+	}
+	for (struct thread *w = urgent->next; w != NULL; w = w->next) {
+		if (w->priority < urgent->priority) {
+			urgent = w;
+		}
+	}
+	queue_remove_node(lock->wait_queue, urgent);
+	thread_wake(urgent);
+}
+
+/* Lend the priority of the running thread, which is about to wait for lock,
+ * to the holder of the lock, and on down the chain of threads that the
+ * holder is itself waiting for (the same chain that can_deadlock walks), so
+ * that no less urgent thread can keep them from running. */
+static void
+lock_inherit(struct lock *lock)
+{
+	int prio = current_thread->priority;
+	struct thread *t = lock->holder;
+
+	while (t != NULL && t != current_thread && t->priority > prio) {
+		thread_set_effective(t, prio);
+		if (t->waiting_for_queue == NULL) {
+			break;
+		}
+		t = queue_get_owner(t->waiting_for_queue);
+	}
+}
+
 struct lock *
 lock_create()
 {
@@ -588,7 +1686,7 @@ lock_create()
         return NULL;
     }
     lock->holder = NULL;
-    lock->wait_queue = queue_create(THREAD_MAX_THREADS);
+    lock->wait_queue = queue_create(max_threads);
 	if (lock->wait_queue == NULL) {
         free(lock);
         interrupt_set(enabled);
@@ -596,6 +1694,7 @@ lock_create()
     }
 	queue_set_owner(lock->wait_queue, &(lock->holder));
     lock->cv_count = 0;
+    lock->next_held = NULL;
     
     interrupt_set(enabled);
     return lock;
@@ -620,6 +1719,7 @@ lock_acquire(struct lock *lock)
     int enabled = interrupt_off();
     assert(lock != NULL);
     while (!(lock->holder == NULL)) {
+        lock_inherit(lock);
         Tid result = thread_sleep(lock->wait_queue);
         interrupt_off(); // Re-disable interrupts after wakeup
         if (result == THREAD_DEADLOCK || result == THREAD_NONE || result == THREAD_INVALID) {
@@ -629,6 +1729,10 @@ lock_acquire(struct lock *lock)
     }
     assert(lock->holder == NULL);
     lock->holder = current_thread;
+    lock->next_held = current_thread->held_locks;
+    current_thread->held_locks = lock;
+    // the threads still waiting for the lock now boost its new holder
+    thread_set_effective(current_thread, thread_inherited_prio(current_thread));
     interrupt_set(enabled);
     return 0;
 }
@@ -640,8 +1744,25 @@ lock_release(struct lock *lock)
     assert(lock != NULL);
     assert(lock->holder == current_thread);
 
+    struct lock **link = &current_thread->held_locks;
+    while (*link != lock) {
+        link = &(*link)->next_held;
+    }
+    *link = lock->next_held;
+    lock->next_held = NULL;
+
     lock->holder = NULL;
-    thread_wakeup(lock->wait_queue, 0);
+    lock_wake_urgent(lock);
+
+    // give back a priority inherited through this lock, and let a more
+    // urgent thread run as soon as interrupts are back on
+    if (current_thread->priority != current_thread->base_priority) {
+        int prio = thread_inherited_prio(current_thread);
+        if (prio != current_thread->priority) {
+            current_thread->priority = prio;
+            interrupt_preempt();
+        }
+    }
     interrupt_set(enabled);
 }
 
@@ -661,7 +1782,7 @@ cv_create(struct lock *lock)
         interrupt_set(enabled);
         return NULL;
     }
-	cv->wait_queue = queue_create(THREAD_MAX_THREADS);
+	cv->wait_queue = queue_create(max_threads);
 	if (cv->wait_queue == NULL) {
 		free(cv);
 		interrupt_set(enabled);
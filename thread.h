@@ -10,20 +10,41 @@
 #define _THREAD_H_
 
 #include "ut369.h"
+#include "heap.h"
 #include <stdbool.h>
-#include <ucontext.h>
+#include <stdint.h>
 
 enum state{running, runnable, zombie, blocked,};
 
 struct thread {
     Tid id;
-    bool in_queue;
+    fifo_queue_t *in_queue;       /* queue holding it, or NULL */
     struct thread *next;
     struct thread *prev;
     enum state state;
     bool is_killed;
-    ucontext_t my_context;
+    int priority;                 /* effective, may be inherited */
+    int base_priority;            /* set by thread_setprio */
+    struct lock *held_locks;      /* linked through lock->next_held */
+    struct heap_node sched_node;  /* used by heap-based schedulers */
+    uint64_t vruntime;            /* virtual time, see cfs.c, stride.c */
+    int tickets;
+    unsigned quantum;             /* own quantum, or 0, see interrupt.c */
+    int level;                    /* mlfq level and its bookkeeping */
+    int level_ticks;
+    unsigned level_epoch;
+    uint64_t deadline;            /* absolute, in ns, 0 if none */
+    bool deadline_missed;
+    int slot;                     /* index in the rand ready array, or -1 */
+    uint64_t stamp;               /* last dispatch, block or wakeup, in ns,
+                                   * kept only for schedulers with hooks */
+    void *saved_sp;
     void *stack_pointer;
+    size_t stack_size;
+    int node;                     /* NUMA node of the stack, or -1 */
+    bool shared_stack;
+    void *saved_stack;        /* live frames while off the shared stack */
+    size_t saved_capacity;
     fifo_queue_t *wait_queue;
     fifo_queue_t *waiting_for_queue;
     int exit_code;
@@ -32,8 +53,29 @@ struct thread {
     struct thread *self;
 };
 
+/* default watermarks of the reaped-thread cache, see struct config */
+#define THREAD_CACHE_HIGH 64
+#define THREAD_CACHE_LOW  16
+
+/* initial number of entries in the thread table, see struct config */
+#define THREAD_TABLE_INIT 64
+
+/* default seed of thread_random, see struct config. Some of the deadlock
+ * tests only pass if rand happens to run the threads in a given order, which
+ * this seed does. */
+#define THREAD_SEED_DEFAULT 3
+
 // functions defined in thread.c
-void thread_init(void);
+void thread_init(const struct config *config);
+int thread_max(void);
+void thread_preempt(void);
+struct thread *thread_get(Tid tid);
+struct thread *thread_current(void);
+uint64_t thread_random(void);
+unsigned thread_random_below(unsigned bound);
+void thread_sched_reset(void);
+int thread_nr_ready(void);
+void thread_idle(void);
 void thread_end(void);
 
 // functions defined in ut369.c
@@ -2,9 +2,11 @@
 #include "interrupt.h"
 #include "thread.h"
 #include "schedule.h"
+#include "carrier.h"
 #include <stdlib.h>
 #include <assert.h>
 #include <malloc.h>
+#include <ucontext.h>
 
 /* Exit status of the process */
 static int exit_status = 0;
@@ -26,6 +28,7 @@ ut369_end(void)
 {
     assert(!interrupt_enabled());
     interrupt_end();
+    carrier_end();
     thread_end();
     scheduler_end();
     exit(exit_status);
@@ -38,10 +41,11 @@ void
 ut369_start(struct config * config)
 {
     srand(0);
+    // the schedulers size their queues with thread_max()
+    thread_init(config);
     scheduler_init(config->sched_name);
-    thread_init();
     if (config->preemptive)
-        interrupt_init(config->verbose ? 1 : 0);
+        interrupt_init(config);
     
     // make sure interrupt is off before we getcontext
     assert(!interrupt_enabled());
@@ -55,6 +59,9 @@ ut369_start(struct config * config)
     }
     called = 1;
 
+    // the other carriers wait for the runtime lock until interrupts are on
+    carrier_start();
+
     // interrupt is enabled from this point forward
     interrupt_on();
 }
@@ -11,14 +11,27 @@
 #define _UT369_H_
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #define THREAD_MAX_THREADS 1024 /* maximum number of threads */
 #define THREAD_MIN_STACK  32768 /* minimum per-thread execution stack */
+#define THREAD_SMALL_STACK 8192 /* smallest stack for thread_create_attr */
+#define THREAD_SHARED_STACK (1 << 20) /* default size of the shared stack */
+
+/* Thread priorities, used by the prio scheduler. 0 is the most urgent. */
+#define THREAD_PRIO_LEVELS  32
+#define THREAD_PRIO_DEFAULT 16
+
+/* Thread tickets, used by the stride and lottery schedulers. */
+#define THREAD_TICKETS_MAX     (1 << 16)
+#define THREAD_TICKETS_DEFAULT 100
 
 typedef int Tid; /* A thread identifier */
 
 /*
- * Valid thread identifiers (Tid) range between 0 and THREAD_MAX_THREADS-1. The
+ * Valid thread identifiers (Tid) range between 0 and max_threads-1, where
+ * max_threads is set in struct config and defaults to THREAD_MAX_THREADS. The
  * first thread to run must have a thread id of 0. Note that this thread is the
  * main thread, i.e., it is created before the first call to thread_create.
  *
@@ -38,10 +51,79 @@ enum {
 /* function type for a new thread's entry point */
 typedef int (* thread_entry_f)(void *);
 
+/* What the quantum of preemptive threads is measured in, see config.clock */
+enum preempt_clock {
+	PREEMPT_CLOCK_REAL = 0,     /* wall-clock time */
+	PREEMPT_CLOCK_CPU,          /* CPU time of the carrier */
+	PREEMPT_CLOCK_INSTRUCTIONS, /* instructions run by the carrier */
+};
+
 struct config {
+    /* Name of a built-in scheduler (e.g., "fcfs"), or path to a scheduler
+     * plugin, see schedule.h. */
     const char * sched_name;
     bool preemptive;
 	bool verbose;
+	/* Reaped threads keep their wait queue in a cache for reuse by
+	 * thread_create, and so do the stacks of exited threads, which are
+	 * cached as soon as the thread exits. Each cache is trimmed back to
+	 * cache_low entries whenever it would exceed cache_high. 0 selects the
+	 * defaults. */
+	int cache_high;
+	int cache_low;
+	/* Maximum number of threads that can exist at once, including the main
+	 * thread. The thread table grows on demand up to this bound, so it may
+	 * be well above THREAD_MAX_THREADS. 0 selects THREAD_MAX_THREADS.
+	 * Each private stack is a mapping plus a guard page, which the kernel
+	 * counts as two of the process's vm.max_map_count mappings (65530 by
+	 * default), so beyond about 32000 live threads thread_create fails with
+	 * THREAD_NOMEMORY unless that limit is raised or the threads use the
+	 * shared stack. */
+	int max_threads;
+	/* Size of the stack shared by threads created with the shared_stack
+	 * attribute. 0 selects THREAD_SHARED_STACK. */
+	size_t shared_stack_size;
+	/* Seed of the generator used by the randomized schedulers (rand,
+	 * lottery). Runs with the same seed make the same choices. 0 selects
+	 * THREAD_SEED_DEFAULT. */
+	uint64_t seed;
+	/* Number of kernel threads that run user threads. ut369_start starts
+	 * carriers - 1 of them next to the calling one, and ready threads run
+	 * on whichever is free, so that they can use several cores. Shared-stack
+	 * threads cannot be created then. 0 or 1 runs all threads on the
+	 * calling kernel thread. */
+	int carriers;
+	/* CPUs to pin the carriers to, one per carrier (carrier 0 being the
+	 * kernel thread that calls ut369_start), or NULL to leave them to the
+	 * kernel. A CPU that cannot be used leaves its carrier unpinned. The
+	 * stack of a new thread is put on the NUMA node of the pinned carrier
+	 * that creates it, and the ws scheduler only moves threads across
+	 * nodes when the imbalance is large enough to be worth it. */
+	const int *cpus;
+	/* Length of the time slice of preemptive threads, in microseconds. A
+	 * thread that runs this long while another one is ready is preempted.
+	 * 0 selects SIG_INTERVAL. */
+	unsigned quantum;
+	/* Clock that measures the quantum. Wall-clock time keeps running while
+	 * the process is descheduled by the OS, so on an oversubscribed host a
+	 * thread can lose its slice without having run. PREEMPT_CLOCK_CPU only
+	 * counts the CPU time (user and system) used by each carrier's kernel
+	 * thread. PREEMPT_CLOCK_INSTRUCTIONS counts quantum thousands of
+	 * user-mode instructions with a hardware perf event; where there is no
+	 * such event (e.g., in a VM or container without a PMU), it falls back
+	 * to the CPU time measured by a software perf event, and then to
+	 * PREEMPT_CLOCK_CPU. */
+	enum preempt_clock clock;
+	/* Bounds of the quantum, in the units of quantum, when it adapts to
+	 * the load. If quantum_max is above quantum_min, each carrier gives
+	 * the next thread a longer slice the fewer threads are waiting, up to
+	 * quantum_max, so that CPU-bound threads are rarely preempted for
+	 * nothing, and a shorter one the more are waiting, down to quantum_min,
+	 * so that they all get the CPU soon. A slice is never so short that
+	 * switching threads takes a noticeable share of it. Otherwise, the
+	 * quantum is fixed. See also thread_set_quantum. */
+	unsigned quantum_min;
+	unsigned quantum_max;
 };
 
 /*
@@ -71,12 +153,39 @@ Tid thread_id(void);
  * - On success: Returns the identifier of the newly created thread.
  * - On failure: Returns one of the following error codes:
  *   - THREAD_NOMORE: The system cannot create additional threads because
- *     the maximum thread limit has been reached.
+ *     the maximum thread limit (max_threads) has been reached.
  *   - THREAD_NOMEMORY: There is insufficient memory to allocate a stack
- *     or other resources required for the new thread.
+ *     or other resources required for the new thread, or the process has
+ *     run out of memory mappings (see max_threads in struct config).
  */
 Tid thread_create(thread_entry_f fn, void *arg);
 
+/* Optional attributes for thread_create_attr. Zero-initialize the structure
+ * to get the defaults used by thread_create. */
+struct thread_attr {
+	/* usable stack size in bytes, rounded up to whole pages and to at least
+	 * THREAD_SMALL_STACK. 0 selects THREAD_MIN_STACK. */
+	size_t stack_size;
+	/* run on the stack shared by all such threads instead of a private one
+	 * (stack_size is then ignored). When switched out, only the live part
+	 * of the thread's stack is copied to a right-sized buffer, so mostly
+	 * idle threads cost little memory, at the price of a copy on each
+	 * switch to a different shared-stack thread. Other threads must not
+	 * access the local variables of a shared-stack thread. */
+	bool shared_stack;
+};
+
+/*
+ * Same as thread_create, but with the attributes in attr (which may be NULL).
+ *
+ * Each stack is followed by an inaccessible guard page and is committed
+ * lazily, so small stacks suit leaf workers and large ones recursive code
+ * without costing memory that is never touched. A thread that overflows its
+ * stack crashes the program with a message naming its Tid.
+ */
+Tid thread_create_attr(thread_entry_f fn, void *arg,
+                       const struct thread_attr *attr);
+
 /*
  * Terminate the execution of the calling thread.
  *
@@ -149,6 +258,138 @@ Tid thread_kill(Tid tid);
  */
 Tid thread_yield(Tid tid);
 
+/*
+ * Set the priority of the thread identified by tid to prio, which must be
+ * between 0 (most urgent) and THREAD_PRIO_LEVELS-1. New threads start at
+ * THREAD_PRIO_DEFAULT. Only schedulers that implement priorities (prio)
+ * take it into account; a change takes effect the next time the thread is
+ * put in the ready queue, or immediately if it is already there. With
+ * preemption on, a woken thread more urgent than the running thread
+ * preempts it.
+ *
+ * Return Values:
+ * - 0 on success.
+ * - THREAD_INVALID: tid does not correspond to an existing thread, or prio
+ *   is out of range.
+ */
+int thread_setprio(Tid tid, int prio);
+
+/*
+ * Return the priority of the thread identified by tid, or THREAD_INVALID if
+ * tid does not correspond to an existing thread. While the thread holds a
+ * lock that a more urgent thread waits for, it inherits the priority of that
+ * thread (transitively, through the chain of threads waiting for each other),
+ * and this returns the inherited priority.
+ */
+int thread_getprio(Tid tid);
+
+/*
+ * Set the number of tickets of the thread identified by tid, which must be
+ * between 1 and THREAD_TICKETS_MAX. New threads start with
+ * THREAD_TICKETS_DEFAULT. Under the stride and lottery schedulers, runnable
+ * threads get a share of the CPU proportional to their tickets; the other
+ * schedulers ignore them.
+ *
+ * Return Values:
+ * - 0 on success.
+ * - THREAD_INVALID: tid does not correspond to an existing thread, or tickets
+ *   is out of range.
+ */
+int thread_set_tickets(Tid tid, int tickets);
+
+/*
+ * Return the number of tickets of the thread identified by tid, or
+ * THREAD_INVALID if tid does not correspond to an existing thread.
+ */
+int thread_get_tickets(Tid tid);
+
+/*
+ * Set the deadline of the thread identified by tid to abs_ns, an absolute
+ * CLOCK_MONOTONIC time in nanoseconds, or clear it if abs_ns is 0. The edf
+ * scheduler runs the ready thread with the earliest deadline first, and
+ * threads without a deadline only when no other thread is ready; a woken
+ * thread with an earlier deadline than the running thread preempts it. The
+ * other schedulers ignore deadlines.
+ *
+ * Return Values:
+ * - 0 on success.
+ * - THREAD_INVALID: tid does not correspond to an existing thread.
+ */
+int thread_set_deadline(Tid tid, uint64_t abs_ns);
+
+/*
+ * Give the thread identified by tid a quantum of its own, in the units of
+ * config.quantum, which it gets whenever it runs instead of the fixed or
+ * adaptive one, or go back to that one if quantum is 0. Has no effect
+ * without preemption.
+ *
+ * Return Values:
+ * - 0 on success.
+ * - THREAD_INVALID: tid does not correspond to an existing thread.
+ */
+int thread_set_quantum(Tid tid, unsigned quantum);
+
+/*
+ * Return the quantum of the thread identified by tid, set by
+ * thread_set_quantum, or 0 if it has none or tid does not correspond to an
+ * existing thread.
+ */
+unsigned thread_get_quantum(Tid tid);
+
+/*
+ * Return the number of deadlines that were missed so far, under any
+ * scheduler. A deadline counts as missed, once, if its thread gets the CPU
+ * or exits after it, or if it has passed when it is replaced by
+ * thread_set_deadline.
+ */
+unsigned long thread_deadline_misses(void);
+
+/*
+ * Switch to the scheduler called name (see struct config) while the program
+ * runs. The ready threads are moved over to the new scheduler, atomically
+ * with respect to preemption, in the order in which the old one would have
+ * run them. Scheduler-specific accounting (e.g., virtual runtimes or mlfq
+ * levels) starts over, while priorities, tickets and deadlines are kept.
+ *
+ * Return Values:
+ * - 0 on success, or if name is the current scheduler.
+ * - THREAD_INVALID: there is no scheduler called name, or name is a path to
+ *   a plugin that could not be loaded.
+ * - THREAD_NOMEMORY: the new scheduler could not be initialized. The old one
+ *   stays in place.
+ */
+int scheduler_switch(const char *name);
+
+/*
+ * A thread handle packs a Tid with the generation of its slot in the thread
+ * table. Once the thread is reaped, its Tid may be reused by a new thread but
+ * the handle stays stale forever, so handles can be cached without extra
+ * bookkeeping. Validating a handle is O(1). 0 is never a valid handle.
+ */
+typedef uint64_t thread_handle_t;
+
+/*
+ * Return the handle of the thread identified by tid, or 0 if tid does not
+ * correspond to an existing thread. Zombies that have not been reaped yet
+ * still have a valid handle.
+ */
+thread_handle_t thread_handle(Tid tid);
+
+/*
+ * Return the Tid of the thread referenced by handle, or THREAD_INVALID if
+ * the handle is stale (i.e., the thread has been reaped) or malformed.
+ */
+Tid thread_handle_tid(thread_handle_t handle);
+
+/*
+ * Same as thread_kill/thread_yield/thread_wait, but the target is given by a
+ * handle. A stale handle returns THREAD_INVALID without affecting any thread
+ * that has since reused its Tid.
+ */
+Tid thread_kill_handle(thread_handle_t handle);
+Tid thread_yield_handle(thread_handle_t handle);
+int thread_wait_handle(thread_handle_t handle, int *exit_code);
+
 /**************************************************************************
  * (A2) API function and type declarations for preemptive threads only
  **************************************************************************/
@@ -0,0 +1,148 @@
+/*
+ * ws.c
+ *
+ * Implementation of a work-stealing scheduler. Each carrier owns a queue of
+ * ready threads: a thread made ready goes to the queue of the carrier that
+ * readied it, a carrier runs the threads of its own queue in FIFO order, and
+ * a carrier whose queue is empty steals the oldest thread of another one,
+ * starting at a random victim. Threads thus tend to stay on one carrier,
+ * where their stacks are cache-warm. Carriers on the same NUMA node are tried
+ * first, and a carrier on another node is only stolen from when it has
+ * WS_REMOTE_STEAL threads waiting, since the stack of a thread that moves
+ * stays behind on the old node.
+ *
+ * The threshold means that dequeue can leave threads waiting on a remote
+ * carrier, so ws_drain empties the queues for scheduler_switch regardless.
+ *
+ * The runtime calls every scheduler function with interrupts disabled, which
+ * with several carriers also holds the runtime lock, so the queues need no
+ * synchronization of their own. This also means that ws is not a lock-free
+ * scheduler: every push, pop and steal is serialized on the runtime lock,
+ * just as under fcfs, and the per-carrier queues only buy locality. Lock-free
+ * (Chase-Lev) deques would pay off once the runtime makes its scheduler calls
+ * outside that lock, which it does not do yet. A thread knows the queue
+ * holding it (see queue.c), so removing it by Tid does not search.
+ */
+
+#include "ut369.h"
+#include "queue.h"
+#include "thread.h"
+#include "schedule.h"
+#include "carrier.h"
+#include "interrupt.h"
+#include <assert.h>
+#include <stdlib.h>
+
+#define WS_REMOTE_STEAL 4  /* waiting threads worth moving to another node */
+
+static fifo_queue_t **queues = NULL;
+static int nr_queues;
+
+int
+ws_init(void)
+{
+    nr_queues = nr_carriers;
+    queues = calloc(nr_queues, sizeof(fifo_queue_t *));
+    if (queues == NULL) {
+        return THREAD_NOMEMORY;
+    }
+    for (int i = 0; i < nr_queues; i++) {
+        queues[i] = queue_create(thread_max());
+        if (queues[i] == NULL) {
+            while (i-- > 0) {
+                queue_destroy(queues[i]);
+            }
+            free(queues);
+            queues = NULL;
+            return THREAD_NOMEMORY;
+        }
+    }
+    return 0;
+}
+
+int
+ws_enqueue(struct thread * thread)
+{
+    assert(!interrupt_enabled());
+    if (queue_push(queues[carrier_self()->index], thread) == 0) {
+        return 0;
+    }
+    return THREAD_NOMORE;
+}
+
+/* Steal a thread for carrier self from another carrier, going through them
+ * from a random one. Remote carriers are only stolen from if remote is set,
+ * and when they have enough threads waiting. */
+static struct thread *
+ws_steal(struct carrier *self, bool remote)
+{
+    int victim = thread_random_below(nr_queues);
+    struct thread *thread = NULL;
+
+    for (int i = 0; i < nr_queues && thread == NULL; i++) {
+        struct carrier *c = carrier_get(victim);
+        if (c != self && carrier_remote(self, c) == remote &&
+            queue_count(queues[victim]) >= (remote ? WS_REMOTE_STEAL : 1)) {
+            thread = queue_pop(queues[victim]);
+        }
+        victim = victim + 1 < nr_queues ? victim + 1 : 0;
+    }
+    return thread;
+}
+
+struct thread *
+ws_dequeue(void)
+{
+    struct carrier *self = carrier_self();
+    struct thread *thread;
+
+    assert(!interrupt_enabled());
+    thread = queue_pop(queues[self->index]);
+    if (thread != NULL || nr_queues == 1) {
+        return thread;
+    }
+    thread = ws_steal(self, false);
+    if (thread == NULL) {
+        thread = ws_steal(self, true);
+    }
+    return thread;
+}
+
+struct thread *
+ws_drain(void)
+{
+    struct thread *thread = ws_dequeue();
+
+    assert(!interrupt_enabled());
+    for (int i = 0; i < nr_queues && thread == NULL; i++) {
+        thread = queue_pop(queues[i]);
+    }
+    return thread;
+}
+
+struct thread *
+ws_remove(Tid tid)
+{
+    struct thread *thread = thread_get(tid);
+
+    assert(!interrupt_enabled());
+    if (thread == NULL) {
+        return NULL;
+    }
+    for (int i = 0; i < nr_queues; i++) {
+        if (thread->in_queue == queues[i]) {
+            return queue_remove_node(queues[i], thread);
+        }
+    }
+    return NULL;
+}
+
+void
+ws_destroy(void)
+{
+    for (int i = 0; i < nr_queues; i++) {
+        queue_destroy(queues[i]);
+    }
+    free(queues);
+    queues = NULL;
+}